@@ -0,0 +1,846 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <getopt.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include "bench.h"
+#include "perf_counters.h"
+
+#ifndef BENCH_BUILD_ID
+#define BENCH_BUILD_ID "unknown"
+#endif
+
+#define DEFAULT_SAMPLES 1000
+#define DEFAULT_WARMUP 100
+#define CALIBRATION_NS 20000000ULL   /* 20 ms per calibration round */
+#define CALIBRATION_ROUNDS 5
+
+#define SWEEP_MIN_BYTES 16ULL
+#define SWEEP_MAX_BYTES (1ULL << 30)
+#define SWEEP_BUDGET_BYTES (256ULL << 20)   /* bytes processed per sweep point */
+#define SWEEP_MIN_SAMPLES 3
+#define CACHE_LINE 64
+#define MAX_ROWS 1024
+#define LEAK_DEFAULT_MEASUREMENTS 20000
+#define LEAK_CROP_PERCENTILE 95     /* second t-test ignores the slowest 5% (interrupts) */
+
+enum { LEVEL_L1, LEVEL_L2, LEVEL_L3, LEVEL_DRAM, NLEVELS };
+static const char *level_names[NLEVELS] = {"L1", "L2", "L3", "DRAM"};
+
+/* one line of output: a case result or one point of a stream sweep */
+typedef struct bench_row {
+    char name[96];
+    const char *variant;        /* "warm"/"cold" for sweep points, NULL for cases */
+    int level;                  /* cache level the working set fits in, -1 for cases */
+    size_t bytes;
+    bench_stats stats;
+    double ns_median;
+    double cycles_per_byte;
+    double gb_per_s;
+    int has_perf;
+    int perf_threaded;          /* multi-threaded case: counters would cover one thread only */
+    perf_counts perf;           /* totals over all samples, excluding setup and flushes */
+} bench_row;
+
+static bench_case cases[BENCH_MAX_CASES];
+static size_t ncases = 0;
+static bench_stream streams[BENCH_MAX_CASES];
+static size_t nstreams = 0;
+static bench_row rows[MAX_ROWS];
+static size_t nrows = 0;
+
+typedef struct leak_result {
+    unsigned measurements;
+    double mean[2];
+    double t_all, t_cropped;
+} leak_result;
+
+typedef struct annotation {
+    char key[32];
+    char value[256];
+} annotation;
+
+static annotation annotations[BENCH_MAX_ANNOTATIONS];
+static size_t nannotations = 0;
+
+static bench_leak leaks[BENCH_MAX_CASES];
+static leak_result leak_results[BENCH_MAX_CASES];
+static size_t nleaks = 0;
+
+static int initialized = 0;
+static double tsc_hz = 0.0;
+static uint64_t tsc_overhead = 0;
+static size_t cache_sizes[NLEVELS - 1];
+static perf_group counters;
+static int use_perf = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* pin process to CPU 0 to reduce core migration noise */
+static void pin_to_cpu0(void) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(0, &cpuset);
+    if (sched_setaffinity(0, sizeof(cpuset), &cpuset) != 0) {
+        perror("sched_setaffinity");
+        /* not fatal */
+    }
+}
+
+/* TSC ticks per second, median of several short spins against the raw monotonic clock */
+static double calibrate_tsc(void) {
+    double rounds[CALIBRATION_ROUNDS];
+    for (int r = 0; r < CALIBRATION_ROUNDS; r++) {
+        uint64_t ns0 = now_ns();
+        uint64_t t0 = bench_tsc_begin();
+        uint64_t ns1;
+        do {
+            ns1 = now_ns();
+        } while (ns1 - ns0 < CALIBRATION_NS);
+        uint64_t t1 = bench_tsc_end();
+        rounds[r] = (double)(t1 - t0) * 1e9 / (double)(ns1 - ns0);
+    }
+    qsort(rounds, CALIBRATION_ROUNDS, sizeof(double), compare_double);
+    return rounds[CALIBRATION_ROUNDS / 2];
+}
+
+/* cost of an empty begin/end pair; subtracted from every sample */
+static uint64_t measure_overhead(void) {
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < 10000; i++) {
+        uint64_t t0 = bench_tsc_begin();
+        uint64_t t1 = bench_tsc_end();
+        if (t1 - t0 < best) best = t1 - t0;
+    }
+    return best;
+}
+
+/* data cache size for a level from sysfs, 0 if unknown */
+static size_t sysfs_cache_size(int level) {
+    char path[128], type[32];
+    for (int idx = 0; idx < 8; idx++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", idx);
+        FILE *f = fopen(path, "r");
+        if (!f) break;
+        int lvl = 0;
+        int ok = fscanf(f, "%d", &lvl) == 1;
+        fclose(f);
+        if (!ok || lvl != level) continue;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", idx);
+        f = fopen(path, "r");
+        if (!f) continue;
+        ok = fscanf(f, "%31s", type) == 1;
+        fclose(f);
+        if (!ok || strcmp(type, "Instruction") == 0) continue;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", idx);
+        f = fopen(path, "r");
+        if (!f) continue;
+        unsigned long kb = 0;
+        ok = fscanf(f, "%luK", &kb) == 1;
+        fclose(f);
+        if (ok) return kb * 1024;
+    }
+    return 0;
+}
+
+static void detect_caches(void) {
+    static const int names[NLEVELS - 1] = {
+        _SC_LEVEL1_DCACHE_SIZE, _SC_LEVEL2_CACHE_SIZE, _SC_LEVEL3_CACHE_SIZE
+    };
+    /* fallbacks if neither sysconf nor sysfs know: 32K / 1M / 32M */
+    static const size_t defaults[NLEVELS - 1] = { 32 << 10, 1 << 20, 32 << 20 };
+    for (int l = 0; l < NLEVELS - 1; l++) {
+        long v = sysconf(names[l]);
+        size_t sz = v > 0 ? (size_t)v : sysfs_cache_size(l + 1);
+        cache_sizes[l] = sz ? sz : defaults[l];
+    }
+}
+
+static int cache_level(size_t working_set) {
+    for (int l = 0; l < NLEVELS - 1; l++) {
+        if (working_set <= cache_sizes[l]) return l;
+    }
+    return LEVEL_DRAM;
+}
+
+void bench_init(void) {
+    if (initialized) return;
+    pin_to_cpu0();
+    tsc_hz = calibrate_tsc();
+    tsc_overhead = measure_overhead();
+    detect_caches();
+    initialized = 1;
+}
+
+double bench_tsc_hz(void) {
+    bench_init();
+    return tsc_hz;
+}
+
+uint64_t bench_tsc_overhead(void) {
+    bench_init();
+    return tsc_overhead;
+}
+
+void bench_compute_stats(uint64_t *samples, unsigned n, bench_stats *out) {
+    memset(out, 0, sizeof(*out));
+    if (n == 0) return;
+
+    qsort(samples, n, sizeof(uint64_t), compare_u64);
+
+    double sum = 0.0;
+    for (unsigned i = 0; i < n; i++) sum += (double)samples[i];
+
+    /* nearest-rank percentiles */
+    unsigned p99_rank = (unsigned)((99ULL * n + 99) / 100);
+    out->min = samples[0];
+    out->median = samples[(n - 1) / 2];
+    out->p99 = samples[p99_rank - 1];
+    out->max = samples[n - 1];
+    out->mean = sum / n;
+    out->samples = n;
+}
+
+int bench_register(const bench_case *c) {
+    if (ncases >= BENCH_MAX_CASES) {
+        fprintf(stderr, "bench: too many cases, dropping %s\n", c->name);
+        return -1;
+    }
+    cases[ncases++] = *c;
+    return 0;
+}
+
+int bench_register_stream(const bench_stream *s) {
+    if (nstreams >= BENCH_MAX_CASES) {
+        fprintf(stderr, "bench: too many streams, dropping %s\n", s->name);
+        return -1;
+    }
+    streams[nstreams++] = *s;
+    return 0;
+}
+
+int bench_register_leak(const bench_leak *l) {
+    if (nleaks >= BENCH_MAX_CASES) {
+        fprintf(stderr, "bench: too many leak tests, dropping %s\n", l->name);
+        return -1;
+    }
+    leaks[nleaks++] = *l;
+    return 0;
+}
+
+static bench_row *new_row(void) {
+    if (nrows >= MAX_ROWS) {
+        fprintf(stderr, "bench: result table full\n");
+        return NULL;
+    }
+    bench_row *r = &rows[nrows++];
+    memset(r, 0, sizeof(*r));
+    r->level = -1;
+    return r;
+}
+
+static void finish_row(bench_row *r, uint64_t *cycles, unsigned n) {
+    bench_compute_stats(cycles, n, &r->stats);
+    r->ns_median = (double)r->stats.median * 1e9 / tsc_hz;
+    if (r->bytes && r->stats.median) {
+        r->cycles_per_byte = (double)r->stats.median / (double)r->bytes;
+        r->gb_per_s = (double)r->bytes / r->ns_median;
+    }
+}
+
+static uint64_t sample_delta(uint64_t t0, uint64_t t1) {
+    uint64_t d = t1 - t0;
+    return d > tsc_overhead ? d - tsc_overhead : 0;
+}
+
+/* counters are toggled outside the TSC window so the ioctls are not timed */
+static void perf_begin(void) {
+    if (use_perf) perf_group_enable(&counters);
+}
+
+static void perf_end(void) {
+    if (use_perf) perf_group_disable(&counters);
+}
+
+static void perf_collect(bench_row *r) {
+    if (use_perf && perf_group_read(&counters, &r->perf) == 0) r->has_perf = 1;
+}
+
+static void run_case(const bench_case *c, unsigned samples, unsigned warmup) {
+    bench_row *r = new_row();
+    if (!r) return;
+    uint64_t *cycles = malloc(samples * sizeof(uint64_t));
+    if (!cycles) {
+        fprintf(stderr, "bench: out of memory for %s\n", c->name);
+        nrows--;
+        return;
+    }
+
+    for (unsigned i = 0; i < warmup; i++) {
+        if (c->setup) c->setup(c->ctx);
+        c->run(c->ctx);
+    }
+
+    if (use_perf) perf_group_reset(&counters);
+    for (unsigned i = 0; i < samples; i++) {
+        if (c->setup) c->setup(c->ctx);
+        perf_begin();
+        uint64_t t0 = bench_tsc_begin();
+        c->run(c->ctx);
+        uint64_t t1 = bench_tsc_end();
+        perf_end();
+        cycles[i] = sample_delta(t0, t1);
+    }
+    if (c->threads > 1) r->perf_threaded = use_perf;
+    else perf_collect(r);
+
+    snprintf(r->name, sizeof(r->name), "%s", c->name);
+    r->bytes = c->bytes;
+    finish_row(r, cycles, samples);
+    free(cycles);
+}
+
+/* evict a buffer from every cache level */
+static void flush_range(const uint8_t *p, size_t len) {
+    for (size_t off = 0; off < len; off += CACHE_LINE) {
+        _mm_clflush(p + off);
+    }
+    _mm_mfence();
+}
+
+static void run_sweep_point(const bench_stream *s, const uint8_t *in, uint8_t *out,
+                            size_t len, int cold, unsigned max_samples) {
+    bench_row *r = new_row();
+    if (!r) return;
+
+    unsigned samples = (unsigned)(SWEEP_BUDGET_BYTES / len);
+    if (samples > max_samples) samples = max_samples;
+    if (samples < SWEEP_MIN_SAMPLES) samples = SWEEP_MIN_SAMPLES;
+
+    uint64_t *cycles = malloc(samples * sizeof(uint64_t));
+    if (!cycles) {
+        nrows--;
+        return;
+    }
+
+    /* one untimed pass so the warm variant starts with the buffers resident */
+    if (!cold) s->fn(s->ctx, in, out, len);
+
+    if (use_perf) perf_group_reset(&counters);
+    for (unsigned i = 0; i < samples; i++) {
+        if (cold) {
+            if (!s->in_place) flush_range(in, len);
+            flush_range(out, len);
+        }
+        perf_begin();
+        uint64_t t0 = bench_tsc_begin();
+        s->fn(s->ctx, in, out, len);
+        uint64_t t1 = bench_tsc_end();
+        perf_end();
+        cycles[i] = sample_delta(t0, t1);
+    }
+    perf_collect(r);
+
+    size_t working_set = s->in_place ? len : 2 * len;
+    snprintf(r->name, sizeof(r->name), "%s/%s/%zu", s->name, cold ? "cold" : "warm", len);
+    r->variant = cold ? "cold" : "warm";
+    r->level = cache_level(working_set);
+    r->bytes = len;
+    finish_row(r, cycles, samples);
+    free(cycles);
+}
+
+static int run_sweeps(const char *filter, size_t min_len, size_t max_len, unsigned max_samples) {
+    uint8_t *in = aligned_alloc(CACHE_LINE, max_len);
+    uint8_t *out = aligned_alloc(CACHE_LINE, max_len);
+    if (!in || !out) {
+        fprintf(stderr, "bench: cannot allocate 2 x %zu bytes for sweep\n", max_len);
+        free(in);
+        free(out);
+        return -1;
+    }
+    memset(in, 'A', max_len);
+    memset(out, 0, max_len);
+
+    for (size_t i = 0; i < nstreams; i++) {
+        const bench_stream *s = &streams[i];
+        if (filter && !strstr(s->name, filter)) continue;
+        size_t align = s->align ? s->align : 1;
+        for (size_t len = min_len; len <= max_len; len *= 2) {
+            size_t n = len - len % align;
+            if (n == 0) continue;
+            for (int cold = 0; cold <= 1; cold++) {
+                run_sweep_point(s, in, out, n, cold, max_samples);
+            }
+        }
+    }
+
+    free(in);
+    free(out);
+    return 0;
+}
+
+/* Welch's t statistic between the two classes, using samples <= limit */
+static double welch_t(const uint64_t *cycles, const uint8_t *cls, unsigned n, uint64_t limit,
+                      double mean_out[2]) {
+    double mean[2] = {0}, m2[2] = {0};
+    unsigned cnt[2] = {0};
+    for (unsigned i = 0; i < n; i++) {
+        if (cycles[i] > limit) continue;
+        int c = cls[i];
+        double x = (double)cycles[i];
+        double delta = x - mean[c];
+        cnt[c]++;
+        mean[c] += delta / cnt[c];
+        m2[c] += delta * (x - mean[c]);
+    }
+    if (mean_out) {
+        mean_out[0] = mean[0];
+        mean_out[1] = mean[1];
+    }
+    if (cnt[0] < 2 || cnt[1] < 2) return 0.0;
+    double var0 = m2[0] / (cnt[0] - 1), var1 = m2[1] / (cnt[1] - 1);
+    double se = sqrt(var0 / cnt[0] + var1 / cnt[1]);
+    return se > 0.0 ? (mean[0] - mean[1]) / se : 0.0;
+}
+
+static void run_leak(const bench_leak *l, leak_result *res) {
+    unsigned n = l->measurements ? l->measurements : LEAK_DEFAULT_MEASUREMENTS;
+    uint64_t *cycles = malloc(n * sizeof(uint64_t));
+    uint64_t *sorted = malloc(n * sizeof(uint64_t));
+    uint8_t *cls = malloc(n);
+    memset(res, 0, sizeof(*res));
+    if (!cycles || !sorted || !cls) {
+        fprintf(stderr, "bench: out of memory for %s\n", l->name);
+        free(cycles);
+        free(sorted);
+        free(cls);
+        return;
+    }
+
+    /* class order from a private xorshift so the program's own rand() is untouched */
+    uint64_t state = bench_tsc_begin() | 1;
+    for (unsigned i = 0; i < n; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        cls[i] = (uint8_t)(state & 1);
+    }
+
+    for (unsigned i = 0; i < n; i++) {
+        l->prepare(l->ctx, cls[i]);
+        uint64_t t0 = bench_tsc_begin();
+        l->run(l->ctx);
+        uint64_t t1 = bench_tsc_end();
+        cycles[i] = sample_delta(t0, t1);
+    }
+
+    memcpy(sorted, cycles, n * sizeof(uint64_t));
+    qsort(sorted, n, sizeof(uint64_t), compare_u64);
+    uint64_t crop = sorted[(size_t)n * LEAK_CROP_PERCENTILE / 100];
+
+    res->measurements = n;
+    res->t_all = welch_t(cycles, cls, n, UINT64_MAX, res->mean);
+    res->t_cropped = welch_t(cycles, cls, n, crop, NULL);
+    free(cycles);
+    free(sorted);
+    free(cls);
+}
+
+static int leak_detected(const leak_result *r) {
+    return fabs(r->t_all) > BENCH_LEAK_T_THRESHOLD || fabs(r->t_cropped) > BENCH_LEAK_T_THRESHOLD;
+}
+
+static void print_leak_table(const int *ran) {
+    printf("# fixed-vs-random leakage, |t| > %.1f means timing depends on the input\n",
+           BENCH_LEAK_T_THRESHOLD);
+    printf("%-36s %12s %14s %14s %10s %10s  %s\n", "name", "measurements", "mean_class0",
+           "mean_class1", "t", "t_p95", "verdict");
+    for (size_t i = 0; i < nleaks; i++) {
+        if (!ran[i]) continue;
+        const leak_result *r = &leak_results[i];
+        printf("%-36s %12u %14.1f %14.1f %10.2f %10.2f  %s\n", leaks[i].name, r->measurements,
+               r->mean[0], r->mean[1], r->t_all, r->t_cropped,
+               leak_detected(r) ? "LEAK" : "constant-time");
+    }
+}
+
+static const char *build_id(void) {
+    const char *env = getenv("BENCH_BUILD_ID");
+    return env && *env ? env : BENCH_BUILD_ID;
+}
+
+int bench_annotate(const char *key, const char *value) {
+    size_t i;
+    for (i = 0; i < nannotations; i++) {
+        if (strcmp(annotations[i].key, key) == 0) break;
+    }
+    if (i == BENCH_MAX_ANNOTATIONS) return -1;
+    snprintf(annotations[i].key, sizeof(annotations[i].key), "%s", key);
+    snprintf(annotations[i].value, sizeof(annotations[i].value), "%s", value);
+    if (i == nannotations) nannotations++;
+    return 0;
+}
+
+/* annotations as one CSV field: key=value pairs joined by ';', commas dropped */
+static void csv_annotations(FILE *f) {
+    for (size_t i = 0; i < nannotations; i++) {
+        if (i) fputc(';', f);
+        fprintf(f, "%s=", annotations[i].key);
+        for (const char *c = annotations[i].value; *c; c++) {
+            if (*c != ',' && *c != '\n') fputc(*c, f);
+        }
+    }
+}
+
+static void print_table(void) {
+    printf("%-36s %10s %12s %12s %12s %14s %12s %8s %8s\n",
+           "name", "bytes", "min", "median", "p99", "mean", "median_ns", "cyc/B", "GB/s");
+    for (size_t i = 0; i < nrows; i++) {
+        const bench_row *r = &rows[i];
+        const bench_stats *s = &r->stats;
+        printf("%-36s %10zu %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %14.1f %12.1f %8.2f %8.3f\n",
+               r->name, r->bytes, s->min, s->median, s->p99, s->mean,
+               r->ns_median, r->cycles_per_byte, r->gb_per_s);
+    }
+}
+
+static double per_op(const bench_row *r, int ev) {
+    return r->perf.valid[ev] ? (double)r->perf.value[ev] / r->stats.samples : -1.0;
+}
+
+/* per-operation counter averages; "-" for events the PMU would not count */
+static void print_perf_table(void) {
+    static const int evs[] = { PERF_EV_CYCLES, PERF_EV_INSTRUCTIONS, PERF_EV_L1D_MISSES,
+                               PERF_EV_LLC_MISSES, PERF_EV_BRANCH_MISSES };
+    printf("# perf counters per operation\n");
+    printf("%-36s %14s %14s %14s %14s %14s %6s %6s\n", "name", "cycles", "instructions",
+           "l1d_misses", "llc_misses", "branch_misses", "IPC", "GHz");
+    for (size_t i = 0; i < nrows; i++) {
+        const bench_row *r = &rows[i];
+        if (r->perf_threaded) {
+            printf("%-36s (multi-threaded; counters follow the calling thread only, not reported)\n", r->name);
+            continue;
+        }
+        if (!r->has_perf) continue;
+        printf("%-36s", r->name);
+        for (size_t k = 0; k < sizeof(evs) / sizeof(evs[0]); k++) {
+            double v = per_op(r, evs[k]);
+            if (v >= 0.0) printf(" %14.1f", v);
+            else printf(" %14s", "-");
+        }
+        double ipc = perf_ipc(&r->perf), ghz = perf_ghz(&r->perf, tsc_hz);
+        if (ipc > 0.0) printf(" %6.2f", ipc);
+        else printf(" %6s", "-");
+        if (ghz > 0.0) printf(" %6.2f\n", ghz);
+        else printf(" %6s\n", "-");
+    }
+}
+
+/* best throughput each stream/variant reached while its working set fit in each level */
+static void print_level_summary(void) {
+    printf("# cache sizes: L1d %zu, L2 %zu, L3 %zu\n", cache_sizes[0], cache_sizes[1], cache_sizes[2]);
+    printf("%-28s %-6s %10s %10s %10s %10s   (peak GB/s)\n", "stream", "mode", "L1", "L2", "L3", "DRAM");
+    for (size_t i = 0; i < nstreams; i++) {
+        for (int cold = 0; cold <= 1; cold++) {
+            const char *variant = cold ? "cold" : "warm";
+            double best[NLEVELS] = {0};
+            int any = 0;
+            size_t prefix = strlen(streams[i].name);
+            for (size_t j = 0; j < nrows; j++) {
+                const bench_row *r = &rows[j];
+                if (!r->variant || strcmp(r->variant, variant) != 0) continue;
+                if (strncmp(r->name, streams[i].name, prefix) != 0 || r->name[prefix] != '/') continue;
+                if (r->gb_per_s > best[r->level]) best[r->level] = r->gb_per_s;
+                any = 1;
+            }
+            if (!any) continue;
+            printf("%-28s %-6s", streams[i].name, variant);
+            for (int l = 0; l < NLEVELS; l++) {
+                if (best[l] > 0.0) printf(" %10.3f", best[l]);
+                else printf(" %10s", "-");
+            }
+            printf("\n");
+        }
+    }
+}
+
+static const char csv_header[] =
+    "build,name,bytes,samples,min_cycles,median_cycles,p99_cycles,"
+    "max_cycles,mean_cycles,median_ns,cycles_per_byte,gb_per_s,tsc_hz,"
+    "ipc,ghz,instructions_per_op,l1d_misses_per_op,llc_misses_per_op,branch_misses_per_op,"
+    "annotations\n";
+
+static int export_csv(const char *path) {
+    FILE *f = fopen(path, "a+");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    /* appending under a different column set would silently misalign every row */
+    char existing[sizeof(csv_header) + 1];
+    rewind(f);
+    if (fgets(existing, sizeof(existing), f)) {
+        if (strcmp(existing, csv_header) != 0) {
+            fprintf(stderr, "bench: %s has a different column set (older build?); not appending, "
+                            "use a new --csv file\n", path);
+            fclose(f);
+            return -1;
+        }
+    } else {
+        fputs(csv_header, f);
+    }
+    for (size_t i = 0; i < nrows; i++) {
+        const bench_row *r = &rows[i];
+        const bench_stats *s = &r->stats;
+        fprintf(f, "%s,%s,%zu,%u,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.1f,%.1f,%.4f,%.4f,%.0f",
+                build_id(), r->name, r->bytes, s->samples, s->min, s->median, s->p99, s->max,
+                s->mean, r->ns_median, r->cycles_per_byte, r->gb_per_s, tsc_hz);
+        if (r->has_perf) {
+            double ipc = perf_ipc(&r->perf), ghz = perf_ghz(&r->perf, tsc_hz);
+            if (ipc > 0.0) fprintf(f, ",%.3f", ipc);
+            else fputc(',', f);
+            if (ghz > 0.0) fprintf(f, ",%.3f", ghz);
+            else fputc(',', f);
+            for (int ev = PERF_EV_INSTRUCTIONS; ev <= PERF_EV_BRANCH_MISSES; ev++) {
+                double v = per_op(r, ev);
+                if (v >= 0.0) fprintf(f, ",%.1f", v);
+                else fputc(',', f);
+            }
+        } else {
+            fprintf(f, ",,,,,,");
+        }
+        fputc(',', f);
+        csv_annotations(f);
+        fputc('\n', f);
+    }
+    fclose(f);
+    return 0;
+}
+
+static void json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', f);
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static int leak_ran[BENCH_MAX_CASES];
+static size_t nleaks_ran = 0;
+
+static int export_json(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fprintf(f, "{\n  \"build\": ");
+    json_string(f, build_id());
+    fprintf(f, ",\n  \"compiler\": ");
+    json_string(f, __VERSION__);
+    fprintf(f, ",\n  \"timestamp\": %lld,\n", (long long)time(NULL));
+    fprintf(f, "  \"tsc_hz\": %.0f,\n  \"tsc_overhead_cycles\": %" PRIu64 ",\n", tsc_hz, tsc_overhead);
+    fprintf(f, "  \"cache_bytes\": {\"L1d\": %zu, \"L2\": %zu, \"L3\": %zu},\n",
+            cache_sizes[0], cache_sizes[1], cache_sizes[2]);
+    fprintf(f, "  \"annotations\": {");
+    for (size_t i = 0; i < nannotations; i++) {
+        fprintf(f, "%s", i ? ", " : "");
+        json_string(f, annotations[i].key);
+        fprintf(f, ": ");
+        json_string(f, annotations[i].value);
+    }
+    fprintf(f, "},\n");
+    fprintf(f, "  \"results\": [");
+    for (size_t i = 0; i < nrows; i++) {
+        const bench_row *r = &rows[i];
+        const bench_stats *s = &r->stats;
+        fprintf(f, "%s\n    {\"name\": ", i ? "," : "");
+        json_string(f, r->name);
+        if (r->variant) {
+            fprintf(f, ", \"variant\": \"%s\", \"level\": \"%s\"", r->variant, level_names[r->level]);
+        }
+        fprintf(f, ", \"bytes\": %zu, \"samples\": %u, \"min_cycles\": %" PRIu64
+                   ", \"median_cycles\": %" PRIu64 ", \"p99_cycles\": %" PRIu64
+                   ", \"max_cycles\": %" PRIu64 ", \"mean_cycles\": %.1f"
+                   ", \"median_ns\": %.1f, \"cycles_per_byte\": %.4f, \"gb_per_s\": %.4f",
+                r->bytes, s->samples, s->min, s->median, s->p99, s->max, s->mean,
+                r->ns_median, r->cycles_per_byte, r->gb_per_s);
+        if (r->has_perf) {
+            /* like the CSV and the table: an uncounted metric is null, not zero */
+            double ipc = perf_ipc(&r->perf), ghz = perf_ghz(&r->perf, tsc_hz);
+            fprintf(f, ",\n     \"perf\": {\"ipc\": ");
+            if (ipc > 0.0) fprintf(f, "%.3f", ipc);
+            else fprintf(f, "null");
+            fprintf(f, ", \"ghz\": ");
+            if (ghz > 0.0) fprintf(f, "%.3f", ghz);
+            else fprintf(f, "null");
+            fprintf(f, ", \"multiplex_scale\": %.3f", r->perf.scale);
+            for (int ev = 0; ev < PERF_NEVENTS; ev++) {
+                if (r->perf.valid[ev]) fprintf(f, ", \"%s_per_op\": %.1f", perf_event_names[ev], per_op(r, ev));
+            }
+            fputc('}', f);
+        }
+        fputc('}', f);
+    }
+    fprintf(f, "\n  ]");
+    if (nleaks_ran) {
+        fprintf(f, ",\n  \"leakage\": [");
+        int first = 1;
+        for (size_t i = 0; i < nleaks; i++) {
+            if (!leak_ran[i]) continue;
+            const leak_result *r = &leak_results[i];
+            fprintf(f, "%s\n    {\"name\": ", first ? "" : ",");
+            json_string(f, leaks[i].name);
+            fprintf(f, ", \"measurements\": %u, \"mean_class0\": %.1f, \"mean_class1\": %.1f"
+                       ", \"t\": %.3f, \"t_p95\": %.3f, \"leak\": %s}",
+                    r->measurements, r->mean[0], r->mean[1], r->t_all, r->t_cropped,
+                    leak_detected(r) ? "true" : "false");
+            first = 0;
+        }
+        fprintf(f, "\n  ]");
+    }
+    fprintf(f, "\n}\n");
+    fclose(f);
+    return 0;
+}
+
+/* byte count with an optional K/M/G suffix */
+static size_t parse_size(const char *arg) {
+    char *end;
+    size_t v = (size_t)strtoull(arg, &end, 0);
+    switch (*end) {
+    case 'G': case 'g': v <<= 10; /* fall through */
+    case 'M': case 'm': v <<= 10; /* fall through */
+    case 'K': case 'k': v <<= 10; break;
+    }
+    return v;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [--samples N] [--warmup N] [--filter SUBSTR] [--csv FILE] [--json FILE] [--perf] [--leak]\n"
+            "       %*s [--sweep [--sweep-min BYTES] [--sweep-max BYTES]]\n",
+            prog, (int)strlen(prog), "");
+}
+
+int bench_main(int argc, char **argv) {
+    unsigned samples = DEFAULT_SAMPLES, warmup = DEFAULT_WARMUP;
+    int samples_given = 0, warmup_given = 0;    /* explicit options beat per-case defaults */
+    const char *filter = NULL, *csv_path = NULL, *json_path = NULL;
+    int sweep = 0, leak = 0;
+    size_t sweep_min = SWEEP_MIN_BYTES, sweep_max = SWEEP_MAX_BYTES;
+
+    static const struct option opts[] = {
+        {"samples", required_argument, NULL, 's'},
+        {"warmup", required_argument, NULL, 'w'},
+        {"filter", required_argument, NULL, 'f'},
+        {"csv", required_argument, NULL, 'c'},
+        {"json", required_argument, NULL, 'j'},
+        {"sweep", no_argument, NULL, 'S'},
+        {"perf", no_argument, NULL, 'p'},
+        {"leak", no_argument, NULL, 'L'},
+        {"sweep-min", required_argument, NULL, 'm'},
+        {"sweep-max", required_argument, NULL, 'M'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        switch (opt) {
+        case 's': samples = (unsigned)strtoul(optarg, NULL, 10); samples_given = 1; break;
+        case 'w': warmup = (unsigned)strtoul(optarg, NULL, 10); warmup_given = 1; break;
+        case 'f': filter = optarg; break;
+        case 'c': csv_path = optarg; break;
+        case 'j': json_path = optarg; break;
+        case 'S': sweep = 1; break;
+        case 'p': use_perf = 1; break;
+        case 'L': leak = 1; break;
+        case 'm': sweep_min = parse_size(optarg); break;
+        case 'M': sweep_max = parse_size(optarg); break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (samples == 0) samples = 1;
+    if (sweep_min == 0) sweep_min = 1;
+    if (sweep_max < sweep_min) sweep_max = sweep_min;
+
+    bench_init();
+    printf("# tsc: %.3f GHz, overhead %" PRIu64 " cycles, build %s\n",
+           tsc_hz / 1e9, tsc_overhead, build_id());
+    for (size_t i = 0; i < nannotations; i++) {
+        printf("# %s: %s\n", annotations[i].key, annotations[i].value);
+    }
+
+    if (use_perf) {
+        if (perf_group_open(&counters) == 0) {
+            printf("# perf counters unavailable (%s); check kernel.perf_event_paranoid or container seccomp\n",
+                   strerror(counters.err));
+            use_perf = 0;
+        } else {
+            printf("# perf counters: %d/%d events\n", counters.nopen, PERF_NEVENTS);
+        }
+    }
+
+    int rc = 0;
+    if (sweep) {
+        if (nstreams == 0) {
+            fprintf(stderr, "bench: no streaming kernels registered, nothing to sweep\n");
+            return 1;
+        }
+        if (run_sweeps(filter, sweep_min, sweep_max, samples) != 0) return 1;
+    } else if (leak) {
+        if (nleaks == 0) {
+            fprintf(stderr, "bench: no leak tests registered\n");
+            return 1;
+        }
+        for (size_t i = 0; i < nleaks; i++) {
+            if (filter && !strstr(leaks[i].name, filter)) continue;
+            run_leak(&leaks[i], &leak_results[i]);
+            leak_ran[i] = 1;
+            nleaks_ran++;
+        }
+    } else {
+        for (size_t i = 0; i < ncases; i++) {
+            if (filter && !strstr(cases[i].name, filter)) continue;
+            unsigned n = cases[i].samples && !samples_given ? cases[i].samples : samples;
+            unsigned w = cases[i].warmup && !warmup_given ? cases[i].warmup : warmup;
+            run_case(&cases[i], n, w);
+        }
+    }
+
+    if (leak) print_leak_table(leak_ran);
+    else print_table();
+    if (use_perf) print_perf_table();
+    if (sweep) print_level_summary();
+    if (use_perf) perf_group_close(&counters);
+
+    if (csv_path && export_csv(csv_path) != 0) rc = 1;
+    if (json_path && export_json(json_path) != 0) rc = 1;
+    return rc;
+}
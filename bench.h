@@ -0,0 +1,120 @@
+/* bench.h - shared cycle-accurate benchmark harness for the primitives in this repo.
+ *
+ * Every timed region is bracketed by a serialized TSC read: LFENCE;RDTSC;LFENCE on
+ * entry and RDTSCP;LFENCE on exit, so neither earlier nor later instructions can
+ * leak into the measurement. The TSC is calibrated against CLOCK_MONOTONIC_RAW at
+ * startup, each case gets a warmup phase and then a fixed number of samples, and
+ * min / median / p99 are reported per case.
+ *
+ * Usage from a program:
+ *
+ *     bench_case c = { .name = "aes128_ecb_encrypt_1k", .run = enc_fn, .ctx = &ctx, .bytes = 1024 };
+ *     bench_register(&c);
+ *     return bench_main(argc, argv);
+ *
+ * Streaming kernels (the symmetric ciphers) can also register a bench_stream; with
+ * --sweep the harness runs them over log-spaced message sizes, cache-warm and
+ * cache-cold, and reports cycles/byte, GB/s and the best throughput per cache level.
+ *
+ * With --perf every timed run is also wrapped in the perf_counters.h group, and IPC,
+ * effective GHz and per-operation instruction / cache-miss / branch-miss counts are
+ * reported alongside the cycle statistics. The counters follow the calling thread
+ * only, so cases that set .threads above 1 are listed as not counted.
+ *
+ * Code that must not leak its input through timing can register a bench_leak; with
+ * --leak the harness runs a dudect-style fixed-vs-random test: inputs of class 0
+ * and class 1 are interleaved at random, and Welch's t statistic between the two
+ * cycle distributions is reported. |t| above BENCH_LEAK_T_THRESHOLD means timing
+ * depends on the input.
+ *
+ * bench_annotate() attaches key/value context to a run, e.g. which dispatched kernel
+ * variant was bound (see cpu_dispatch.h); it is printed with the header and written
+ * to the CSV and JSON exports.
+ *
+ * Build: cc -O2 aes.c bench.c perf_counters.c cpu_dispatch.c -lcrypto -lm -o aes
+ * Options: --samples N --warmup N --filter SUBSTR --csv FILE --json FILE --perf --leak
+ *          --sweep [--sweep-min BYTES] [--sweep-max BYTES]   (sizes accept K/M/G)
+ * (--csv appends, so one file can collect rows from many builds; set the build tag
+ * with -DBENCH_BUILD_ID=\"...\" or the BENCH_BUILD_ID environment variable.)
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <x86intrin.h>
+
+#define BENCH_MAX_CASES 64
+#define BENCH_LEAK_T_THRESHOLD 4.5
+#define BENCH_MAX_ANNOTATIONS 8
+
+typedef struct bench_case {
+    const char *name;
+    void (*setup)(void *ctx);   /* untimed, called before every sample; may be NULL */
+    void (*run)(void *ctx);     /* the timed region */
+    void *ctx;
+    size_t bytes;               /* bytes processed per run, 0 if not meaningful */
+    unsigned samples;           /* per-case sample count, 0 = global default; --samples wins */
+    unsigned warmup;            /* per-case warmup count, 0 = global default; --warmup wins */
+    unsigned threads;           /* threads the run uses; above 1, --perf leaves the row out */
+} bench_case;
+
+/* a kernel that transforms len bytes from in to out; in may be ignored if in_place */
+typedef struct bench_stream {
+    const char *name;
+    void (*fn)(void *ctx, const uint8_t *in, uint8_t *out, size_t len);
+    void *ctx;
+    size_t align;               /* lengths are rounded down to a multiple of this, 0 = 1 */
+    int in_place;               /* kernel only touches out, so the working set is len */
+} bench_stream;
+
+/* fixed-vs-random timing leakage test */
+typedef struct bench_leak {
+    const char *name;
+    void (*prepare)(void *ctx, int cls);    /* untimed: load an input of class 0 or 1 */
+    void (*run)(void *ctx);                 /* the timed region */
+    void *ctx;
+    unsigned measurements;                  /* 0 = 20000 */
+} bench_leak;
+
+typedef struct bench_stats {
+    uint64_t min, median, p99, max;
+    double mean;
+    unsigned samples;
+} bench_stats;
+
+/* serialized TSC read for the start of a timed region */
+static inline uint64_t bench_tsc_begin(void) {
+    _mm_lfence();
+    uint64_t t = __rdtsc();
+    _mm_lfence();
+    return t;
+}
+
+/* serialized TSC read for the end of a timed region */
+static inline uint64_t bench_tsc_end(void) {
+    unsigned int aux;
+    uint64_t t = __rdtscp(&aux);
+    _mm_lfence();
+    return t;
+}
+
+/* pin to CPU 0 and calibrate the TSC; idempotent, called by bench_main */
+void bench_init(void);
+double bench_tsc_hz(void);
+uint64_t bench_tsc_overhead(void);
+
+/* compute min/median/p99/max/mean; sorts samples in place */
+void bench_compute_stats(uint64_t *samples, unsigned n, bench_stats *out);
+
+int bench_register(const bench_case *c);
+int bench_register_stream(const bench_stream *s);
+int bench_register_leak(const bench_leak *l);
+
+/* record key: value with the results; a repeated key replaces the old value */
+int bench_annotate(const char *key, const char *value);
+
+/* parse options, run every registered case (or stream sweep, or leak test), print a table and export results */
+int bench_main(int argc, char **argv);
+
+#endif
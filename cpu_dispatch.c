@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <cpuid.h>
+#include "cpu_dispatch.h"
+
+#define MAX_SELECTIONS 16
+
+static const struct {
+    unsigned bit;
+    const char *name;
+} feature_table[] = {
+    { CPU_AESNI, "aesni" }, { CPU_PCLMUL, "pclmul" }, { CPU_AVX, "avx" }, { CPU_AVX2, "avx2" },
+    { CPU_AVX512F, "avx512f" }, { CPU_VAES, "vaes" }, { CPU_BMI2, "bmi2" }, { CPU_ADX, "adx" },
+};
+#define NFEATURES (sizeof(feature_table) / sizeof(feature_table[0]))
+
+static int detected = 0;
+static unsigned features = 0;
+static char feature_names[128];
+
+static struct {
+    const char *kernel;
+    const char *variant;
+} selections[MAX_SELECTIONS];
+static size_t nselections = 0;
+static char report[512];
+
+static unsigned long long read_xcr0(void) {
+    unsigned int lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+static unsigned detect(void) {
+    unsigned int a, b, c, d;
+    unsigned f = 0;
+    if (!__get_cpuid(1, &a, &b, &c, &d)) return 0;
+
+    if (c & bit_AES) f |= CPU_AESNI;
+    if (c & bit_PCLMUL) f |= CPU_PCLMUL;
+
+    /* AVX state must be enabled by the OS, not just present in the CPU */
+    int ymm_ok = 0, zmm_ok = 0;
+    if (c & bit_OSXSAVE) {
+        unsigned long long xcr0 = read_xcr0();
+        ymm_ok = (xcr0 & 0x6) == 0x6;           /* XMM | YMM */
+        zmm_ok = ymm_ok && (xcr0 & 0xe0) == 0xe0;   /* opmask | ZMM_Hi256 | Hi16_ZMM */
+    }
+    if (ymm_ok && (c & bit_AVX)) f |= CPU_AVX;
+
+    if (__get_cpuid_count(7, 0, &a, &b, &c, &d)) {
+        if (ymm_ok && (b & bit_AVX2)) f |= CPU_AVX2;
+        if (zmm_ok && (b & bit_AVX512F)) f |= CPU_AVX512F;
+        if (ymm_ok && (c & bit_VAES)) f |= CPU_VAES;
+        if (b & bit_BMI2) f |= CPU_BMI2;
+        if (b & bit_ADX) f |= CPU_ADX;
+    }
+    return f;
+}
+
+/* CPU_DISPATCH_DISABLE=avx512f,vaes -> mask of bits to clear */
+static unsigned disabled_features(void) {
+    const char *env = getenv("CPU_DISPATCH_DISABLE");
+    unsigned mask = 0;
+    while (env && *env) {
+        size_t len = strcspn(env, ", ");
+        for (size_t i = 0; i < NFEATURES; i++) {
+            if (strlen(feature_table[i].name) == len && strncmp(env, feature_table[i].name, len) == 0)
+                mask |= feature_table[i].bit;
+        }
+        env += len;
+        env += strspn(env, ", ");
+    }
+    return mask;
+}
+
+unsigned cpu_features(void) {
+    if (!detected) {
+        features = detect() & ~disabled_features();
+        size_t used = 0;
+        feature_names[0] = '\0';
+        for (size_t i = 0; i < NFEATURES; i++) {
+            if (!(features & feature_table[i].bit)) continue;
+            used += snprintf(feature_names + used, sizeof(feature_names) - used, "%s%s",
+                             used ? " " : "", feature_table[i].name);
+        }
+        detected = 1;
+    }
+    return features;
+}
+
+const char *cpu_feature_names(void) {
+    cpu_features();
+    return feature_names;
+}
+
+static void record_selection(const char *kernel, const char *variant) {
+    for (size_t i = 0; i < nselections; i++) {
+        if (strcmp(selections[i].kernel, kernel) == 0) {
+            selections[i].variant = variant;
+            return;
+        }
+    }
+    if (nselections < MAX_SELECTIONS) {
+        selections[nselections].kernel = kernel;
+        selections[nselections].variant = variant;
+        nselections++;
+    }
+}
+
+size_t cpu_dispatch_select(const char *kernel, const cpu_variant *first, size_t stride, size_t n) {
+    unsigned have = cpu_features();
+    const char *base = (const char *)first;
+
+    /* CPU_DISPATCH_<KERNEL>, upper-cased */
+    char env_name[64];
+    size_t len = (size_t)snprintf(env_name, sizeof(env_name), "CPU_DISPATCH_%s", kernel);
+    for (size_t i = 0; i < len && i < sizeof(env_name); i++) env_name[i] = (char)toupper((unsigned char)env_name[i]);
+    const char *forced = getenv(env_name);
+
+    if (forced && *forced) {
+        for (size_t i = 0; i < n; i++) {
+            const cpu_variant *v = (const cpu_variant *)(base + i * stride);
+            if (strcmp(v->name, forced) != 0) continue;
+            if ((v->requires & have) == v->requires) {
+                record_selection(kernel, v->name);
+                return i;
+            }
+            fprintf(stderr, "cpu_dispatch: %s=%s needs features this CPU lacks; selecting automatically\n",
+                    env_name, forced);
+            forced = NULL;
+            break;
+        }
+        if (forced) {
+            fprintf(stderr, "cpu_dispatch: %s=%s is not a known variant; selecting automatically\n",
+                    env_name, forced);
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        const cpu_variant *v = (const cpu_variant *)(base + i * stride);
+        if ((v->requires & have) == v->requires) {
+            record_selection(kernel, v->name);
+            return i;
+        }
+    }
+    /* tables end with a portable entry, so this is only reached for a malformed table */
+    record_selection(kernel, ((const cpu_variant *)(base + (n - 1) * stride))->name);
+    return n - 1;
+}
+
+const char *cpu_dispatch_report(void) {
+    size_t used = 0;
+    report[0] = '\0';
+    for (size_t i = 0; i < nselections && used < sizeof(report); i++) {
+        used += snprintf(report + used, sizeof(report) - used, "%s%s=%s",
+                         used ? " " : "", selections[i].kernel, selections[i].variant);
+    }
+    return report;
+}
@@ -0,0 +1,58 @@
+/* cpu_dispatch.h - runtime CPU feature detection and kernel variant selection.
+ *
+ * Features are read once with CPUID (and XGETBV, so AVX/AVX-512 are only reported
+ * when the OS saves their register state). Each kernel keeps a best-first table of
+ * variants, every entry starting with a cpu_variant that names it and lists the
+ * features it needs; CPU_DISPATCH_SELECT returns the index of the first entry the
+ * CPU can run, and the program binds its function pointers from that entry.
+ *
+ * Environment overrides for A/B runs:
+ *   CPU_DISPATCH_<KERNEL>=name   force a variant, e.g. CPU_DISPATCH_AES=openssl
+ *   CPU_DISPATCH_DISABLE=list    hide features, e.g. CPU_DISPATCH_DISABLE=avx512f,vaes
+ * A forced variant whose features are missing is refused with a warning rather than
+ * left to die on SIGILL.
+ *
+ * cpu_dispatch_report() lists what was bound ("aes=aesni chacha20=avx2"), so the
+ * benchmarks can record which variant actually ran.
+ *
+ * Kernels: aes (aes.c), chacha20 (chacha.c), rc4 (rc4.c), modexp (modexp.c, used by
+ * rsa.c and rsa_crs2407.c).
+ * Build: cc -O2 rsa.c bench.c perf_counters.c cpu_dispatch.c modexp.c -lgmp -lm -o rsa
+ */
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+#include <stddef.h>
+
+enum {
+    CPU_AESNI   = 1u << 0,
+    CPU_PCLMUL  = 1u << 1,
+    CPU_AVX     = 1u << 2,
+    CPU_AVX2    = 1u << 3,
+    CPU_AVX512F = 1u << 4,
+    CPU_VAES    = 1u << 5,
+    CPU_BMI2    = 1u << 6,
+    CPU_ADX     = 1u << 7,
+};
+
+typedef struct cpu_variant {
+    const char *name;
+    unsigned requires;      /* CPU_* bits that must all be present */
+} cpu_variant;
+
+/* detected features minus CPU_DISPATCH_DISABLE */
+unsigned cpu_features(void);
+
+/* space-separated names of the usable features, e.g. "aesni pclmul avx avx2" */
+const char *cpu_feature_names(void);
+
+/* index of the variant to use; table entries are stride bytes apart and start with a cpu_variant */
+size_t cpu_dispatch_select(const char *kernel, const cpu_variant *first, size_t stride, size_t n);
+
+#define CPU_DISPATCH_SELECT(kernel, table) \
+    cpu_dispatch_select((kernel), &(table)[0].variant, sizeof((table)[0]), sizeof(table) / sizeof((table)[0]))
+
+/* "kernel=variant ..." for every selection made so far */
+const char *cpu_dispatch_report(void);
+
+#endif
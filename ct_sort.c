@@ -0,0 +1,112 @@
+#include <immintrin.h>
+#include "ct_sort.h"
+
+/* branch-free compare-exchange: afterwards *a <= *b */
+static inline void ct_minmax(int32_t *a, int32_t *b) {
+    int64_t diff = (int64_t)*b - (int64_t)*a;
+    uint32_t mask = (uint32_t)(diff >> 32);     /* all ones iff *b < *a */
+    uint32_t t = ((uint32_t)*a ^ (uint32_t)*b) & mask;
+    *a = (int32_t)((uint32_t)*a ^ t);
+    *b = (int32_t)((uint32_t)*b ^ t);
+}
+
+/* smallest power of two with top >= n - top */
+static size_t network_top(size_t n) {
+    size_t top = 1;
+    while (top < n - top) top += top;
+    return top;
+}
+
+void ct_sort_scalar(int32_t *x, size_t n) {
+    if (n < 2) return;
+    size_t top = network_top(n);
+
+    for (size_t p = top; p > 0; p >>= 1) {
+        for (size_t i = 0; i < n - p; ++i) {
+            if (!(i & p)) ct_minmax(&x[i], &x[i + p]);
+        }
+        size_t i = 0;
+        for (size_t q = top; q > p; q >>= 1) {
+            for (; i < n - q; ++i) {
+                if (!(i & p)) {
+                    int32_t a = x[i + p];
+                    for (size_t r = q; r > p; r >>= 1) ct_minmax(&a, &x[i + r]);
+                    x[i + p] = a;
+                }
+            }
+        }
+    }
+}
+
+/* 8 comparators at once; only valid when the two ranges do not overlap */
+__attribute__((target("avx2")))
+static inline void minmax8(int32_t *a, int32_t *b) {
+    __m256i va = _mm256_loadu_si256((const __m256i *)a);
+    __m256i vb = _mm256_loadu_si256((const __m256i *)b);
+    _mm256_storeu_si256((__m256i *)a, _mm256_min_epi32(va, vb));
+    _mm256_storeu_si256((__m256i *)b, _mm256_max_epi32(va, vb));
+}
+
+/*
+ * Same comparator sequence as ct_sort_scalar. For p >= 8 the eight indices
+ * i..i+7 of an aligned group share the (i & p) bit, so a whole group is either
+ * active or skipped and its comparators are independent; r > p >= 8 keeps the
+ * loaded ranges disjoint. The loop bounds still depend only on n.
+ */
+__attribute__((target("avx2")))
+void ct_sort_avx2(int32_t *x, size_t n) {
+    if (n < 2) return;
+    size_t top = network_top(n);
+
+    for (size_t p = top; p > 0; p >>= 1) {
+        size_t i = 0;
+        if (p >= 8) {
+            for (; i + 8 <= n - p; i += 8) {
+                if (!(i & p)) minmax8(&x[i], &x[i + p]);
+            }
+        }
+        for (; i < n - p; ++i) {
+            if (!(i & p)) ct_minmax(&x[i], &x[i + p]);
+        }
+
+        i = 0;
+        for (size_t q = top; q > p; q >>= 1) {
+            while (i < n - q) {
+                if (p >= 8 && !(i & 7) && i + 8 <= n - q) {
+                    if (!(i & p)) {
+                        __m256i a = _mm256_loadu_si256((const __m256i *)&x[i + p]);
+                        for (size_t r = q; r > p; r >>= 1) {
+                            __m256i b = _mm256_loadu_si256((const __m256i *)&x[i + r]);
+                            _mm256_storeu_si256((__m256i *)&x[i + r], _mm256_max_epi32(a, b));
+                            a = _mm256_min_epi32(a, b);
+                        }
+                        _mm256_storeu_si256((__m256i *)&x[i + p], a);
+                    }
+                    i += 8;
+                } else {
+                    if (!(i & p)) {
+                        int32_t a = x[i + p];
+                        for (size_t r = q; r > p; r >>= 1) ct_minmax(&a, &x[i + r]);
+                        x[i + p] = a;
+                    }
+                    ++i;
+                }
+            }
+        }
+    }
+}
+
+static int have_avx2(void) {
+    static int cached = -1;
+    if (cached < 0) cached = __builtin_cpu_supports("avx2") ? 1 : 0;
+    return cached;
+}
+
+void ct_sort(int32_t *x, size_t n) {
+    if (have_avx2()) ct_sort_avx2(x, n);
+    else ct_sort_scalar(x, n);
+}
+
+const char *ct_sort_variant(void) {
+    return have_avx2() ? "avx2" : "scalar";
+}
@@ -0,0 +1,31 @@
+/* ct_sort.h - constant-time sorting network for int32 arrays.
+ *
+ * The comparator sequence depends only on n, never on the data, and each
+ * comparator is a branch-free min/max, so the memory access pattern and the
+ * instruction trace are identical for every input of a given length. This makes it
+ * usable where the order of the inputs is secret (lattice / code-based samplers),
+ * unlike insertion_sort and qsort which branch on the data.
+ *
+ * The network is the merge-exchange layout used by djbsort: it handles any n
+ * without padding and does O(n log^2 n) comparators. The AVX2 variant runs every
+ * comparator layer whose stride is at least 8 as 8-lane vpminsd/vpmaxsd; the
+ * scalar variant is the portable fallback and the reference.
+ *
+ * Build: cc -O2 sort.c radix_sort.c ct_sort.c bench.c perf_counters.c -lpthread -lm -o sort
+ */
+#ifndef CT_SORT_H
+#define CT_SORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* sort ascending; picks the AVX2 variant when the CPU supports it */
+void ct_sort(int32_t *x, size_t n);
+
+void ct_sort_scalar(int32_t *x, size_t n);
+void ct_sort_avx2(int32_t *x, size_t n);
+
+/* "avx2" or "scalar": what ct_sort dispatches to on this CPU */
+const char *ct_sort_variant(void);
+
+#endif
@@ -0,0 +1,472 @@
+/* file_encrypt.c - pipelined streaming file encryption with AES-128-CTR or ChaCha20.
+ *
+ * A reader thread, one or more cipher workers and a writer thread share a ring of
+ * chunk buffers, so reading chunk i+1, encrypting chunk i and writing chunk i-1
+ * overlap. Memory use is bounded by ring_depth * chunk_size no matter how big the
+ * file is. Both ciphers are seekable (the keystream position is derived from the
+ * byte offset), so chunks can be encrypted by any worker in any order and the writer
+ * only has to put them back in sequence. Encryption and decryption are the same
+ * operation.
+ *
+ * Build: cc -O2 file_encrypt.c -lcrypto -lsodium -lpthread -o file_encrypt
+ * Usage: file_encrypt [-c aes-ctr|chacha20] (-K KEYFILE | -k KEYHEX) -n NONCEHEX [-b CHUNK]
+ *                     [-d DEPTH] [-w WORKERS] [--direct] INPUT OUTPUT
+ *   KEYFILE holds the key as hex ("-" reads it from stdin). Prefer it to -k, whose
+ *   argument any local user can read from ps or /proc/<pid>/cmdline.
+ *   aes-ctr:  16-byte key, 16-byte initial counter block
+ *   chacha20: 32-byte key, 8-byte nonce (same construction as chacha.c)
+ *   CHUNK accepts K/M/G and is rounded up to 4 KiB; DEPTH is raised to WORKERS + 2
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+#include <sodium.h>
+
+#define DEFAULT_CHUNK (4UL << 20)
+#define DEFAULT_DEPTH 3             /* triple buffering: read, encrypt, write in flight */
+#define DIRECT_ALIGN 4096           /* O_DIRECT buffer, offset and length alignment */
+#define MAX_WORKERS 64
+
+enum cipher_kind { CIPHER_AES_CTR, CIPHER_CHACHA20 };
+enum slot_state { SLOT_FREE, SLOT_FULL, SLOT_BUSY, SLOT_DONE };
+
+typedef struct chunk_slot {
+    unsigned char *buf;
+    size_t len;
+    off_t offset;
+    unsigned long seq;
+    enum slot_state state;
+} chunk_slot;
+
+typedef struct pipeline {
+    int in_fd, out_fd;
+    int in_direct, out_direct;  /* O_DIRECT actually in effect on each side */
+    enum cipher_kind cipher;
+    unsigned char key[32];
+    unsigned char nonce[16];
+    size_t chunk_size;
+
+    chunk_slot *slots;
+    unsigned depth;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    unsigned long next_work;        /* next chunk a worker may claim */
+    unsigned long total_chunks;     /* set by the reader at EOF */
+    int eof;
+    int error;
+} pipeline;
+
+static void fail(pipeline *p, const char *what) {
+    perror(what);
+    pthread_mutex_lock(&p->lock);
+    p->error = 1;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/* AES-CTR counter block for a byte offset: 128-bit big-endian iv + offset / 16 */
+static void ctr_for_offset(const unsigned char *iv, off_t offset, unsigned char *out) {
+    uint64_t add = (uint64_t)offset / 16;
+    unsigned carry = 0;
+    memcpy(out, iv, 16);
+    for (int i = 15; i >= 0; i--) {
+        unsigned sum = out[i] + (unsigned)(add & 0xff) + carry;
+        out[i] = (unsigned char)sum;
+        carry = sum >> 8;
+        add >>= 8;
+    }
+}
+
+static int encrypt_chunk(pipeline *p, EVP_CIPHER_CTX *ctx, chunk_slot *s) {
+    if (p->cipher == CIPHER_CHACHA20) {
+        /* chunk offsets are multiples of 64, so the block counter is exact */
+        return crypto_stream_chacha20_xor_ic(s->buf, s->buf, s->len, p->nonce,
+                                             (uint64_t)s->offset / 64, p->key);
+    }
+
+    unsigned char ctr[16];
+    int outl;
+    ctr_for_offset(p->nonce, s->offset, ctr);
+    if (EVP_EncryptInit_ex(ctx, EVP_aes_128_ctr(), NULL, p->key, ctr) != 1) return -1;
+    for (size_t done = 0; done < s->len; ) {
+        int step = s->len - done > (1U << 30) ? (1 << 30) : (int)(s->len - done);
+        if (EVP_EncryptUpdate(ctx, s->buf + done, &outl, s->buf + done, step) != 1) return -1;
+        done += (size_t)step;
+    }
+    return 0;
+}
+
+static ssize_t read_full(pipeline *p, unsigned char *buf, size_t len, off_t offset) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t r = pread(p->in_fd, buf + got, len - got, offset + (off_t)got);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (r == 0) break;
+        got += (size_t)r;
+        /* Linux caps one read at 0x7ffff000 bytes, so a short read alone is not the tail. An
+           O_DIRECT read ending off the alignment is, and retrying at that offset would fail. */
+        if (p->in_direct && (size_t)r % DIRECT_ALIGN != 0) break;
+    }
+    return (ssize_t)got;
+}
+
+static int write_full(pipeline *p, const unsigned char *buf, size_t len, off_t offset) {
+    /* O_DIRECT cannot write a short final chunk; drop it for that write only */
+    if (p->out_direct && len % DIRECT_ALIGN != 0) {
+        int flags = fcntl(p->out_fd, F_GETFL);
+        fcntl(p->out_fd, F_SETFL, flags & ~O_DIRECT);
+    }
+    size_t put = 0;
+    while (put < len) {
+        ssize_t w = pwrite(p->out_fd, buf + put, len - put, offset + (off_t)put);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        put += (size_t)w;
+    }
+    return 0;
+}
+
+static void *reader_main(void *arg) {
+    pipeline *p = arg;
+    off_t offset = 0;
+    for (unsigned long seq = 0; ; seq++) {
+        chunk_slot *s = &p->slots[seq % p->depth];
+
+        pthread_mutex_lock(&p->lock);
+        while (s->state != SLOT_FREE && !p->error) pthread_cond_wait(&p->changed, &p->lock);
+        int stop = p->error;
+        pthread_mutex_unlock(&p->lock);
+        if (stop) return NULL;
+
+        ssize_t n = read_full(p, s->buf, p->chunk_size, offset);
+        if (n < 0) {
+            fail(p, "read");
+            return NULL;
+        }
+
+        pthread_mutex_lock(&p->lock);
+        if (n > 0) {
+            s->len = (size_t)n;
+            s->offset = offset;
+            s->seq = seq;
+            s->state = SLOT_FULL;
+        }
+        if ((size_t)n < p->chunk_size) {
+            p->total_chunks = n > 0 ? seq + 1 : seq;
+            p->eof = 1;
+        }
+        pthread_cond_broadcast(&p->changed);
+        pthread_mutex_unlock(&p->lock);
+
+        if (p->eof) return NULL;
+        offset += n;
+    }
+}
+
+static void *worker_main(void *arg) {
+    pipeline *p = arg;
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    if (!ctx) {
+        fail(p, "EVP_CIPHER_CTX_new");
+        return NULL;
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&p->lock);
+        chunk_slot *s;
+        for (;;) {
+            s = &p->slots[p->next_work % p->depth];
+            if (p->error || (p->eof && p->next_work >= p->total_chunks)) {
+                s = NULL;
+                break;
+            }
+            if (s->state == SLOT_FULL && s->seq == p->next_work) break;
+            pthread_cond_wait(&p->changed, &p->lock);
+        }
+        if (s) {
+            s->state = SLOT_BUSY;
+            p->next_work++;
+        }
+        pthread_mutex_unlock(&p->lock);
+        if (!s) break;
+
+        if (encrypt_chunk(p, ctx, s) != 0) {
+            errno = EIO;
+            fail(p, "encrypt");
+            break;
+        }
+
+        pthread_mutex_lock(&p->lock);
+        s->state = SLOT_DONE;
+        pthread_cond_broadcast(&p->changed);
+        pthread_mutex_unlock(&p->lock);
+    }
+
+    EVP_CIPHER_CTX_free(ctx);
+    return NULL;
+}
+
+static void *writer_main(void *arg) {
+    pipeline *p = arg;
+    for (unsigned long seq = 0; ; seq++) {
+        chunk_slot *s = &p->slots[seq % p->depth];
+
+        pthread_mutex_lock(&p->lock);
+        while (!p->error && !(p->eof && seq >= p->total_chunks) &&
+               !(s->state == SLOT_DONE && s->seq == seq)) {
+            pthread_cond_wait(&p->changed, &p->lock);
+        }
+        int stop = p->error || (p->eof && seq >= p->total_chunks);
+        pthread_mutex_unlock(&p->lock);
+        if (stop) return NULL;
+
+        if (write_full(p, s->buf, s->len, s->offset) != 0) {
+            fail(p, "write");
+            return NULL;
+        }
+
+        pthread_mutex_lock(&p->lock);
+        s->state = SLOT_FREE;
+        pthread_cond_broadcast(&p->changed);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+/* byte count with an optional K/M/G suffix; unlike the harness's version this one sizes
+   the ring buffers, so trailing junk, signs and overflow are errors rather than guesses */
+static int parse_size(const char *arg, size_t *out) {
+    char *end;
+    if (*arg < '0' || *arg > '9') return -1;
+    errno = 0;
+    unsigned long long v = strtoull(arg, &end, 0);
+    if (errno == ERANGE || end == arg) return -1;
+    int shift = 0;
+    switch (*end) {
+    case 'G': case 'g': shift = 30; end++; break;
+    case 'M': case 'm': shift = 20; end++; break;
+    case 'K': case 'k': shift = 10; end++; break;
+    }
+    if (*end != '\0' || v > (SIZE_MAX - (DIRECT_ALIGN - 1)) >> shift) return -1;
+    *out = (size_t)v << shift;
+    return 0;
+}
+
+static int parse_hex(const char *hex, unsigned char *out, size_t len) {
+    if (strlen(hex) != 2 * len) return -1;
+    for (size_t i = 0; i < len; i++) {
+        unsigned v;
+        if (sscanf(hex + 2 * i, "%2x", &v) != 1) return -1;
+        out[i] = (unsigned char)v;
+    }
+    return 0;
+}
+
+/* key hex from a file or stdin, trailing whitespace removed; the caller wipes buf */
+static int read_key_file(const char *path, char *buf, size_t size) {
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    size_t n = fread(buf, 1, size - 1, f);
+    int err = ferror(f);
+    if (f != stdin) fclose(f);
+    if (err) {
+        fprintf(stderr, "%s: read error\n", path);
+        return -1;
+    }
+    while (n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == '\r' || buf[n - 1] == ' ' || buf[n - 1] == '\t')) n--;
+    buf[n] = '\0';
+    return 0;
+}
+
+static int open_file(const char *path, int flags, int direct, int *direct_used) {
+    int fd = -1;
+    if (direct) {
+        fd = open(path, flags | O_DIRECT, 0644);
+        if (fd < 0 && errno == EINVAL) {
+            fprintf(stderr, "%s: O_DIRECT not supported here, using buffered I/O\n", path);
+        }
+    }
+    if (fd >= 0) {
+        *direct_used = 1;
+        return fd;
+    }
+    *direct_used = 0;
+    return open(path, flags, 0644);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-c aes-ctr|chacha20] (-K KEYFILE | -k KEYHEX) -n NONCEHEX [-b CHUNK]\n"
+            "       %*s [-d DEPTH] [-w WORKERS] [--direct] INPUT OUTPUT\n",
+            prog, (int)strlen(prog), "");
+}
+
+int main(int argc, char **argv) {
+    pipeline p;
+    memset(&p, 0, sizeof(p));
+    p.cipher = CIPHER_AES_CTR;
+    p.chunk_size = DEFAULT_CHUNK;
+    p.depth = DEFAULT_DEPTH;
+    unsigned workers = 1;
+    const char *key_hex = NULL, *key_path = NULL, *nonce_hex = NULL;
+    char key_buf[2 * 32 + 64];
+    int direct = 0;
+
+    static const struct option opts[] = {
+        {"cipher", required_argument, NULL, 'c'},
+        {"key", required_argument, NULL, 'k'},
+        {"key-file", required_argument, NULL, 'K'},
+        {"nonce", required_argument, NULL, 'n'},
+        {"chunk", required_argument, NULL, 'b'},
+        {"depth", required_argument, NULL, 'd'},
+        {"workers", required_argument, NULL, 'w'},
+        {"direct", no_argument, NULL, 'D'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "c:k:K:n:b:d:w:", opts, NULL)) != -1) {
+        switch (opt) {
+        case 'c':
+            if (strcmp(optarg, "aes-ctr") == 0) p.cipher = CIPHER_AES_CTR;
+            else if (strcmp(optarg, "chacha20") == 0) p.cipher = CIPHER_CHACHA20;
+            else { usage(argv[0]); return 1; }
+            break;
+        case 'k': key_hex = optarg; break;
+        case 'K': key_path = optarg; break;
+        case 'n': nonce_hex = optarg; break;
+        case 'b':
+            if (parse_size(optarg, &p.chunk_size) != 0) {
+                fprintf(stderr, "bad chunk size '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'd': p.depth = (unsigned)strtoul(optarg, NULL, 10); break;
+        case 'w': workers = (unsigned)strtoul(optarg, NULL, 10); break;
+        case 'D': direct = 1; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (argc - optind != 2 || !key_hex == !key_path || !nonce_hex) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (sodium_init() < 0) {
+        return 1;
+    }
+
+    if (key_path) {
+        if (read_key_file(key_path, key_buf, sizeof(key_buf)) != 0) {
+            sodium_memzero(key_buf, sizeof(key_buf));
+            return 1;
+        }
+        key_hex = key_buf;
+    }
+    size_t key_len = p.cipher == CIPHER_AES_CTR ? 16 : crypto_stream_chacha20_KEYBYTES;
+    size_t nonce_len = p.cipher == CIPHER_AES_CTR ? 16 : crypto_stream_chacha20_NONCEBYTES;
+    int bad_key = parse_hex(key_hex, p.key, key_len) != 0;
+    sodium_memzero(key_buf, sizeof(key_buf));
+    if (bad_key || parse_hex(nonce_hex, p.nonce, nonce_len) != 0) {
+        fprintf(stderr, "key must be %zu and nonce %zu bytes of hex\n", key_len, nonce_len);
+        sodium_memzero(p.key, sizeof(p.key));
+        return 1;
+    }
+
+    /* chunks start on keystream-block and O_DIRECT boundaries */
+    p.chunk_size = (p.chunk_size + DIRECT_ALIGN - 1) & ~(size_t)(DIRECT_ALIGN - 1);
+    if (p.chunk_size == 0) p.chunk_size = DIRECT_ALIGN;
+    if (workers < 1) workers = 1;
+    if (workers > MAX_WORKERS) workers = MAX_WORKERS;
+    if (p.depth < workers + 2) p.depth = workers + 2;   /* keep every stage busy */
+
+    p.in_fd = open_file(argv[optind], O_RDONLY, direct, &p.in_direct);
+    if (p.in_fd < 0) {
+        perror(argv[optind]);
+        return 1;
+    }
+    p.out_fd = open_file(argv[optind + 1], O_WRONLY | O_CREAT | O_TRUNC, direct, &p.out_direct);
+    if (p.out_fd < 0) {
+        perror(argv[optind + 1]);
+        return 1;
+    }
+    if (!p.in_direct) posix_fadvise(p.in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    p.slots = calloc(p.depth, sizeof(chunk_slot));
+    if (!p.slots) {
+        printf("Memory allocation failed\n");
+        return 1;
+    }
+    for (unsigned i = 0; i < p.depth; i++) {
+        p.slots[i].buf = aligned_alloc(DIRECT_ALIGN, p.chunk_size);
+        if (!p.slots[i].buf) {
+            printf("Memory allocation failed\n");
+            return 1;
+        }
+    }
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.changed, NULL);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    /* thread table: reader, workers..., writer */
+    pthread_t threads[MAX_WORKERS + 2];
+    unsigned started = 0;
+    void *(*roles[MAX_WORKERS + 2])(void *);
+    roles[0] = reader_main;
+    for (unsigned i = 0; i < workers; i++) roles[1 + i] = worker_main;
+    roles[workers + 1] = writer_main;
+    for (; started < workers + 2; started++) {
+        if (pthread_create(&threads[started], NULL, roles[started], &p) != 0) {
+            errno = EAGAIN;
+            fail(&p, "pthread_create");
+            break;
+        }
+    }
+    for (unsigned i = 0; i < started; i++) pthread_join(threads[i], NULL);
+
+    /* the clock stops after fsync, so buffered runs report disk bandwidth, not page-cache speed */
+    int rc = p.error;
+    if (!rc && fsync(p.out_fd) != 0) {
+        perror("fsync");
+        rc = 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    close(p.in_fd);
+    close(p.out_fd);
+
+    struct stat st;
+    if (!rc && stat(argv[optind + 1], &st) == 0) {
+        double secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+        fprintf(stderr, "%s: %lld bytes in %.3f s (%.3f GB/s), chunk %zu, depth %u, workers %u%s\n",
+                p.cipher == CIPHER_AES_CTR ? "aes-128-ctr" : "chacha20", (long long)st.st_size, secs,
+                secs > 0 ? (double)st.st_size / secs / 1e9 : 0.0, p.chunk_size, p.depth, workers,
+                p.in_direct || p.out_direct ? ", O_DIRECT" : "");
+    }
+
+    sodium_memzero(p.key, sizeof(p.key));
+    for (unsigned i = 0; i < p.depth; i++) free(p.slots[i].buf);
+    free(p.slots);
+    pthread_mutex_destroy(&p.lock);
+    pthread_cond_destroy(&p.changed);
+    return rc;
+}
@@ -0,0 +1,47 @@
+#include <string.h>
+#include "histogram.h"
+
+void hist_init(histogram *h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+/* inverse of hist_index: [lo, hi] range covered by a bucket */
+static void bucket_range(unsigned idx, uint64_t *lo, uint64_t *hi) {
+    if (idx < 2 * HIST_SUB) {
+        *lo = *hi = idx;
+        return;
+    }
+    unsigned shift = idx / HIST_SUB - 1;
+    uint64_t mantissa = idx - (uint64_t)shift * HIST_SUB;
+    *lo = mantissa << shift;
+    *hi = *lo + ((1ULL << shift) - 1);
+}
+
+uint64_t hist_percentile(const histogram *h, double pct) {
+    if (h->count == 0) return 0;
+    if (pct <= 0.0) return h->min;
+    if (pct >= 100.0) return h->max;
+
+    /* nearest-rank: smallest value with at least pct% of samples at or below it */
+    uint64_t rank = (uint64_t)(pct / 100.0 * (double)h->count + 0.999999);
+    if (rank == 0) rank = 1;
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < HIST_NBUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t lo, hi;
+            bucket_range(i, &lo, &hi);
+            uint64_t v = lo + (hi - lo) / 2;
+            if (v < h->min) v = h->min;
+            if (v > h->max) v = h->max;
+            return v;
+        }
+    }
+    return h->max;
+}
+
+double hist_mean(const histogram *h) {
+    return h->count ? h->sum / (double)h->count : 0.0;
+}
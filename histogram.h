@@ -0,0 +1,45 @@
+/* histogram.h - log-bucketed (HDR-style) cycle-count histogram.
+ *
+ * Values below 2^HIST_SUB_BITS are stored exactly; above that every power-of-two
+ * range is split into 2^HIST_SUB_BITS linear sub-buckets, so any recorded value is
+ * known to within 1/128 (~0.8%) of itself across the full 64-bit range. Recording
+ * is a couple of shifts and an increment, with no allocation and no I/O, which makes
+ * it safe to call between timed regions of a measurement loop.
+ */
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+#define HIST_SUB_BITS 7
+#define HIST_SUB (1u << HIST_SUB_BITS)
+#define HIST_NBUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct histogram {
+    uint64_t count;
+    uint64_t min, max;
+    double sum;
+    uint64_t buckets[HIST_NBUCKETS];
+} histogram;
+
+static inline unsigned hist_index(uint64_t v) {
+    if (v < HIST_SUB) return (unsigned)v;
+    unsigned shift = (unsigned)(63 - __builtin_clzll(v)) - HIST_SUB_BITS;
+    return shift * HIST_SUB + (unsigned)(v >> shift);
+}
+
+static inline void hist_record(histogram *h, uint64_t v) {
+    h->buckets[hist_index(v)]++;
+    h->count++;
+    h->sum += (double)v;
+    if (v < h->min) h->min = v;
+    if (v > h->max) h->max = v;
+}
+
+void hist_init(histogram *h);
+
+/* value at the given percentile (0..100), midpoint of its bucket clamped to [min, max] */
+uint64_t hist_percentile(const histogram *h, double pct);
+double hist_mean(const histogram *h);
+
+#endif
@@ -2,6 +2,7 @@
 #include <gmp.h>
 #include <time.h>
 #include <stdlib.h>
+#include "bench.h"
 
 void miller_rabin(mpz_t n, int iterations, int *is_probably_prime) {
     if (mpz_cmp_ui(n, 2) < 0) {
@@ -71,7 +72,18 @@ void miller_rabin(mpz_t n, int iterations, int *is_probably_prime) {
     gmp_randclear(state);
 }
 
-int main() {
+typedef struct {
+    mpz_ptr n;
+    int iterations;
+    int is_probably_prime;
+} miller_rabin_bench_ctx;
+
+static void bench_miller_rabin(void *arg) {
+    miller_rabin_bench_ctx *c = arg;
+    miller_rabin(c->n, c->iterations, &c->is_probably_prime);
+}
+
+int main(int argc, char **argv) {
     mpz_t n;
     mpz_init(n);
 
@@ -81,27 +93,28 @@ int main() {
 
     unsigned long bits = 1024;
     int iterations = 10;
-    int is_probably_prime;
 
     mpz_urandomb(n, state, bits);
     mpz_setbit(n, bits - 1);
     mpz_nextprime(n, n);
 
-    clock_t start = clock();
-    for (int i = 0; i < 1000; i++) {
-        miller_rabin(n, iterations, &is_probably_prime);
-    }
-    clock_t end = clock();
+    miller_rabin_bench_ctx ctx = { n, iterations, 0 };
+    bench_case c = { .name = "miller_rabin_1024_k10", .run = bench_miller_rabin, .ctx = &ctx,
+                     .samples = 200, .warmup = 10 };
+    bench_register(&c);
 
-    double time_taken = (double)(end - start) / CLOCKS_PER_SEC;
+    int rc = bench_main(argc, argv);
+
+    /* the verdict comes from a run of its own: --filter, --sweep or --leak may skip the case */
+    int is_probably_prime;
+    miller_rabin(n, iterations, &is_probably_prime);
 
     gmp_printf("Number tested: %Zd\n", n);
     printf("Miller-Rabin iterations: %d\n", iterations);
     printf("Is probably prime: %s\n", is_probably_prime ? "Yes" : "No");
-    printf("Total time for 1000 iterations: %f seconds\n", time_taken);
 
     mpz_clear(n);
     gmp_randclear(state);
 
-    return 0;
+    return rc;
 }
\ No newline at end of file
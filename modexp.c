@@ -0,0 +1,43 @@
+#include <stdio.h>
+#include "modexp.h"
+#include "cpu_dispatch.h"
+
+typedef void (*modexp_fn)(mpz_t rop, const mpz_t base, const mpz_t exp, const mpz_t mod);
+
+static void modexp_gmp(mpz_t rop, const mpz_t base, const mpz_t exp, const mpz_t mod) {
+    mpz_powm(rop, base, exp, mod);
+}
+
+static void modexp_gmp_sec(mpz_t rop, const mpz_t base, const mpz_t exp, const mpz_t mod) {
+    if (mpz_odd_p(mod) && mpz_sgn(exp) > 0) mpz_powm_sec(rop, base, exp, mod);
+    else mpz_powm(rop, base, exp, mod);
+}
+
+/* best first; the last entry runs anywhere */
+static const struct {
+    cpu_variant variant;
+    modexp_fn fn;
+} modexp_variants[] = {
+    { { "gmp", 0 }, modexp_gmp },
+    { { "gmp_sec", 0 }, modexp_gmp_sec },
+};
+
+static modexp_fn modexp_impl = modexp_gmp;
+static char backend[64];
+
+const char *modexp_dispatch_init(void) {
+    size_t v = CPU_DISPATCH_SELECT("modexp", modexp_variants);
+    modexp_impl = modexp_variants[v].fn;
+    return modexp_variants[v].variant.name;
+}
+
+void modexp(mpz_t rop, const mpz_t base, const mpz_t exp, const mpz_t mod) {
+    modexp_impl(rop, base, exp, mod);
+}
+
+const char *modexp_backend(void) {
+    unsigned f = cpu_features();
+    snprintf(backend, sizeof(backend), "gmp %s, cpu: %s %s", gmp_version,
+             f & CPU_BMI2 ? "bmi2" : "no-bmi2", f & CPU_ADX ? "adx" : "no-adx");
+    return backend;
+}
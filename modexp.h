@@ -0,0 +1,29 @@
+/* modexp.h - dispatched modular exponentiation for the RSA programs.
+ *
+ * Variants:
+ *   gmp      mpz_powm, the fastest path
+ *   gmp_sec  mpz_powm_sec, whose timing and memory access pattern do not depend on
+ *            the exponent; falls back to mpz_powm for an even modulus or exp <= 0
+ *
+ * Neither needs a CPU feature of its own: GMP picks its mpn multiply kernels
+ * (mulx/adcx/adox on BMI2/ADX parts) when it is built, or at startup in a fat
+ * build, and does not say which it chose. modexp_backend() therefore reports only
+ * the GMP version and what the CPU offers (its BMI2/ADX bits); a generic or
+ * non-fat libgmp prints the same line on the same machine.
+ * Override with CPU_DISPATCH_MODEXP=gmp_sec.
+ */
+#ifndef MODEXP_H
+#define MODEXP_H
+
+#include <gmp.h>
+
+/* bind the modexp kernel; returns the variant name */
+const char *modexp_dispatch_init(void);
+
+/* rop = base^exp mod mod through the bound variant */
+void modexp(mpz_t rop, const mpz_t base, const mpz_t exp, const mpz_t mod);
+
+/* e.g. "gmp 6.3.0, cpu: bmi2 adx" -- CPU capability, not the mpn kernels GMP runs */
+const char *modexp_backend(void);
+
+#endif
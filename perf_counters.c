@@ -0,0 +1,130 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perf_counters.h"
+
+const char *perf_event_names[PERF_NEVENTS] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses", "task_clock_ns", "ref_cycles"
+};
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} event_specs[PERF_NEVENTS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_REF_CPU_CYCLES },
+};
+
+static long perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu, int group_fd,
+                            unsigned long flags) {
+    return syscall(SYS_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+int perf_group_open(perf_group *g) {
+    memset(g, 0, sizeof(*g));
+    g->leader = -1;
+    for (int i = 0; i < PERF_NEVENTS; i++) g->fd[i] = -1;
+
+    for (int i = 0; i < PERF_NEVENTS; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = event_specs[i].type;
+        attr.config = event_specs[i].config;
+        attr.disabled = g->leader < 0;  /* only the leader starts disabled */
+        attr.exclude_kernel = 1;        /* allowed at perf_event_paranoid <= 2 */
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+                           PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        int fd = (int)perf_event_open(&attr, 0, -1, g->leader, 0);
+        if (fd < 0) {
+            if (!g->err) g->err = errno;
+            continue;
+        }
+        if (ioctl(fd, PERF_EVENT_IOC_ID, &g->id[i]) != 0) {
+            if (!g->err) g->err = errno;
+            close(fd);
+            continue;
+        }
+        g->fd[i] = fd;
+        if (g->leader < 0) g->leader = fd;
+        g->nopen++;
+    }
+    return g->nopen;
+}
+
+void perf_group_reset(perf_group *g) {
+    if (g->leader >= 0) ioctl(g->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+}
+
+void perf_group_enable(perf_group *g) {
+    if (g->leader >= 0) ioctl(g->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void perf_group_disable(perf_group *g) {
+    if (g->leader >= 0) ioctl(g->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+
+int perf_group_read(perf_group *g, perf_counts *out) {
+    memset(out, 0, sizeof(*out));
+    out->scale = 1.0;
+    if (g->leader < 0) return -1;
+
+    /* PERF_FORMAT_GROUP layout: nr, time_enabled, time_running, {value, id}[nr] */
+    uint64_t buf[3 + 2 * PERF_NEVENTS];
+    ssize_t n = read(g->leader, buf, sizeof(buf));
+    if (n < (ssize_t)(3 * sizeof(uint64_t))) return -1;
+
+    uint64_t nr = buf[0], enabled = buf[1], running = buf[2];
+    if (running == 0) return -1;    /* never got onto the PMU */
+    if (running < enabled) out->scale = (double)enabled / (double)running;
+
+    for (uint64_t k = 0; k < nr && k < PERF_NEVENTS; k++) {
+        uint64_t value = buf[3 + 2 * k], id = buf[4 + 2 * k];
+        for (int i = 0; i < PERF_NEVENTS; i++) {
+            if (g->fd[i] >= 0 && g->id[i] == id) {
+                out->value[i] = (uint64_t)((double)value * out->scale);
+                out->valid[i] = 1;
+            }
+        }
+    }
+    return 0;
+}
+
+void perf_group_close(perf_group *g) {
+    /* close members before the leader */
+    for (int i = PERF_NEVENTS - 1; i >= 0; i--) {
+        if (g->fd[i] >= 0) close(g->fd[i]);
+        g->fd[i] = -1;
+    }
+    g->leader = -1;
+    g->nopen = 0;
+}
+
+double perf_ipc(const perf_counts *c) {
+    if (!c->valid[PERF_EV_CYCLES] || !c->valid[PERF_EV_INSTRUCTIONS] || c->value[PERF_EV_CYCLES] == 0)
+        return 0.0;
+    return (double)c->value[PERF_EV_INSTRUCTIONS] / (double)c->value[PERF_EV_CYCLES];
+}
+
+/* cycles and ref-cycles cover the same user-mode intervals, so their ratio scales the
+   reference rate to the core clock; no ref-cycles (e.g. AMD) means no figure */
+double perf_ghz(const perf_counts *c, double ref_hz) {
+    if (!c->valid[PERF_EV_CYCLES] || !c->valid[PERF_EV_REF_CYCLES] || c->value[PERF_EV_REF_CYCLES] == 0 ||
+        ref_hz <= 0.0)
+        return 0.0;
+    return (double)c->value[PERF_EV_CYCLES] / (double)c->value[PERF_EV_REF_CYCLES] * ref_hz / 1e9;
+}
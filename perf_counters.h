@@ -0,0 +1,68 @@
+/* perf_counters.h - grouped hardware performance counters via perf_event_open.
+ *
+ * A perf_group opens cycles, instructions, L1D read misses, LLC misses, branch
+ * misses, task-clock and ref-cycles as one group, so they are scheduled onto the
+ * PMU together and read atomically. Events the kernel or hypervisor refuses are
+ * skipped; if none can be opened (containers, perf_event_paranoid, no PMU in the
+ * VM) the group is marked unavailable and every call becomes a no-op.
+ *
+ *     perf_group g;
+ *     perf_group_open(&g);
+ *     perf_group_enable(&g);   region();   perf_group_disable(&g);
+ *     perf_counts c;
+ *     perf_group_read(&g, &c);
+ *     perf_group_close(&g);
+ *
+ * Counts are scaled by time_enabled/time_running when the kernel multiplexed the group.
+ *
+ * The group is opened with pid 0 and no inherit, so it counts the calling thread
+ * only; work done by threads the region spawns is not included. Hardware events
+ * are user-mode only (exclude_kernel), so the effective frequency comes from
+ * cycles / ref-cycles, both user-mode, rather than from task-clock, which also
+ * runs during syscalls and page faults.
+ */
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdint.h>
+
+enum {
+    PERF_EV_CYCLES,
+    PERF_EV_INSTRUCTIONS,
+    PERF_EV_L1D_MISSES,
+    PERF_EV_LLC_MISSES,
+    PERF_EV_BRANCH_MISSES,
+    PERF_EV_TASK_CLOCK,         /* nanoseconds on CPU, user and kernel */
+    PERF_EV_REF_CYCLES,         /* constant-rate reference cycles, used for the effective frequency */
+    PERF_NEVENTS
+};
+
+typedef struct perf_group {
+    int fd[PERF_NEVENTS];       /* -1 for events that could not be opened */
+    uint64_t id[PERF_NEVENTS];
+    int leader;                 /* fd of the group leader, -1 if unavailable */
+    int nopen;
+    int err;                    /* errno of the first failure, for diagnostics */
+} perf_group;
+
+typedef struct perf_counts {
+    uint64_t value[PERF_NEVENTS];
+    int valid[PERF_NEVENTS];
+    double scale;               /* time_enabled / time_running, 1.0 if never multiplexed */
+} perf_counts;
+
+extern const char *perf_event_names[PERF_NEVENTS];
+
+/* returns the number of events opened; 0 means counters are unavailable */
+int perf_group_open(perf_group *g);
+void perf_group_reset(perf_group *g);
+void perf_group_enable(perf_group *g);
+void perf_group_disable(perf_group *g);
+int perf_group_read(perf_group *g, perf_counts *out);
+void perf_group_close(perf_group *g);
+
+/* derived metrics; return 0.0 when the inputs were not counted */
+double perf_ipc(const perf_counts *c);
+double perf_ghz(const perf_counts *c, double ref_hz);   /* ref_hz: rate of ref-cycles (the TSC) */
+
+#endif
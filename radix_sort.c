@@ -0,0 +1,266 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <emmintrin.h>
+#include "radix_sort.h"
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES 4
+#define CACHE_LINE 64
+#define WC_LINE (CACHE_LINE / sizeof(uint32_t))   /* keys per write-combining line */
+#define MIN_PER_THREAD 65536    /* below this an extra worker costs more than it saves */
+
+/* one cache line of staging per bucket, kept hot in L1 by its owner */
+typedef struct wc_buffer {
+    uint32_t line[RADIX_BUCKETS][WC_LINE] __attribute__((aligned(CACHE_LINE)));
+    uint32_t fill[RADIX_BUCKETS];   /* keys currently staged */
+    uint32_t room[RADIX_BUCKETS];   /* keys until the destination reaches a line boundary */
+} wc_buffer;
+
+typedef struct radix_job {
+    uint32_t *bufs[2];
+    size_t n;
+    unsigned nthreads;
+    size_t (*counts)[RADIX_BUCKETS];    /* per-thread histogram of the current pass */
+    size_t (*offsets)[RADIX_BUCKETS];   /* per-thread scatter positions */
+    wc_buffer *wc;
+    int skip_pass;
+    pthread_barrier_t barrier;
+
+    /* start gate: workers wait here until every thread exists, or the launch is abandoned */
+    pthread_mutex_t gate_lock;
+    pthread_cond_t gate_cond;
+    int gate_state;                     /* 0 = waiting, 1 = go, -1 = abort */
+} radix_job;
+
+typedef struct radix_worker {
+    radix_job *job;
+    unsigned id;
+} radix_worker;
+
+static inline unsigned radix_digit(uint32_t key, unsigned pass) {
+    unsigned d = (key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1);
+    /* flip the sign bit in the top digit so negative keys sort first */
+    return pass == RADIX_PASSES - 1 ? d ^ (RADIX_BUCKETS >> 1) : d;
+}
+
+static inline unsigned lines_room(const uint32_t *dst) {
+    return (unsigned)(WC_LINE - (((uintptr_t)dst & (CACHE_LINE - 1)) / sizeof(uint32_t)));
+}
+
+/* full lines are line-aligned by construction, so they can bypass the cache */
+static inline void wc_flush(uint32_t *dst, const uint32_t *line, unsigned count) {
+    if (count == WC_LINE) {
+        const __m128i *s = (const __m128i *)line;
+        __m128i *d = (__m128i *)dst;
+        _mm_stream_si128(d, _mm_load_si128(s));
+        _mm_stream_si128(d + 1, _mm_load_si128(s + 1));
+        _mm_stream_si128(d + 2, _mm_load_si128(s + 2));
+        _mm_stream_si128(d + 3, _mm_load_si128(s + 3));
+    } else {
+        memcpy(dst, line, count * sizeof(uint32_t));
+    }
+}
+
+static void scatter(const uint32_t *in, size_t lo, size_t hi, uint32_t *out,
+                    size_t *pos, wc_buffer *wc, unsigned pass) {
+    for (unsigned b = 0; b < RADIX_BUCKETS; b++) {
+        wc->fill[b] = 0;
+        wc->room[b] = lines_room(out + pos[b]);
+    }
+
+    for (size_t i = lo; i < hi; i++) {
+        uint32_t key = in[i];
+        unsigned b = radix_digit(key, pass);
+        wc->line[b][wc->fill[b]++] = key;
+        if (wc->fill[b] == wc->room[b]) {
+            wc_flush(out + pos[b], wc->line[b], wc->fill[b]);
+            pos[b] += wc->fill[b];
+            wc->fill[b] = 0;
+            wc->room[b] = WC_LINE;
+        }
+    }
+
+    for (unsigned b = 0; b < RADIX_BUCKETS; b++) {
+        if (wc->fill[b]) {
+            memcpy(out + pos[b], wc->line[b], wc->fill[b] * sizeof(uint32_t));
+            pos[b] += wc->fill[b];
+        }
+    }
+    _mm_sfence();
+}
+
+/* bucket-major, thread-minor exclusive prefix sum; keeps the sort stable */
+static void prefix_sum(radix_job *job) {
+    size_t total = 0;
+    job->skip_pass = 0;
+    for (unsigned b = 0; b < RADIX_BUCKETS; b++) {
+        size_t bucket_total = 0;
+        for (unsigned t = 0; t < job->nthreads; t++) {
+            job->offsets[t][b] = total;
+            total += job->counts[t][b];
+            bucket_total += job->counts[t][b];
+        }
+        if (bucket_total == job->n) job->skip_pass = 1;    /* every key has this digit */
+    }
+}
+
+static void *radix_worker_main(void *arg) {
+    radix_worker *w = arg;
+    radix_job *job = w->job;
+    unsigned t = w->id;
+    size_t lo = job->n * t / job->nthreads;
+    size_t hi = job->n * (t + 1) / job->nthreads;
+
+    pthread_mutex_lock(&job->gate_lock);
+    while (job->gate_state == 0) pthread_cond_wait(&job->gate_cond, &job->gate_lock);
+    int go = job->gate_state > 0;
+    pthread_mutex_unlock(&job->gate_lock);
+    if (!go) return NULL;
+
+    int src = 0;
+    for (unsigned pass = 0; pass < RADIX_PASSES; pass++) {
+        const uint32_t *in = job->bufs[src];
+        size_t *count = job->counts[t];
+
+        memset(count, 0, RADIX_BUCKETS * sizeof(size_t));
+        for (size_t i = lo; i < hi; i++) count[radix_digit(in[i], pass)]++;
+
+        pthread_barrier_wait(&job->barrier);
+        if (t == 0) prefix_sum(job);
+        pthread_barrier_wait(&job->barrier);
+
+        if (job->skip_pass) continue;
+        scatter(in, lo, hi, job->bufs[src ^ 1], job->offsets[t], &job->wc[t], pass);
+        pthread_barrier_wait(&job->barrier);
+        src ^= 1;
+    }
+
+    /* odd number of scatters: the result is in the scratch buffer */
+    if (src) memcpy(job->bufs[0] + lo, job->bufs[1] + lo, (hi - lo) * sizeof(uint32_t));
+    return NULL;
+}
+
+static void open_gate(radix_job *job, int state) {
+    pthread_mutex_lock(&job->gate_lock);
+    job->gate_state = state;
+    pthread_cond_broadcast(&job->gate_cond);
+    pthread_mutex_unlock(&job->gate_lock);
+}
+
+/* CPUs the process may run on, captured before main so that a caller pinning itself
+   (bench_init pins to CPU 0) does not shrink the set the workers are spread over */
+static cpu_set_t allowed_cpus;
+static unsigned nallowed_cpus = 1;
+
+__attribute__((constructor)) static void capture_allowed_cpus(void) {
+    CPU_ZERO(&allowed_cpus);
+    if (sched_getaffinity(0, sizeof(allowed_cpus), &allowed_cpus) != 0 || CPU_COUNT(&allowed_cpus) == 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        CPU_ZERO(&allowed_cpus);
+        for (long c = 0; c < ncpu && c < CPU_SETSIZE; c++) CPU_SET((int)c, &allowed_cpus);
+    }
+    nallowed_cpus = (unsigned)CPU_COUNT(&allowed_cpus);
+    if (nallowed_cpus < 1) nallowed_cpus = 1;
+}
+
+unsigned radix_sort_cpus(void) {
+    return nallowed_cpus;
+}
+
+/* the k-th allowed CPU, wrapping around */
+static int allowed_cpu(unsigned k) {
+    k %= nallowed_cpus;
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, &allowed_cpus) && k-- == 0) return c;
+    }
+    return 0;
+}
+
+/* spread workers over the allowed CPUs; if one CPU is refused, still let the worker
+   run anywhere in the allowed set rather than inherit the caller's pin */
+static int spawn_worker(pthread_t *th, radix_worker *w) {
+    pthread_attr_t attr;
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(allowed_cpu(w->id), &cpus);
+    pthread_attr_init(&attr);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+    int rc = pthread_create(th, &attr, radix_worker_main, w);
+    if (rc != 0) {
+        pthread_attr_setaffinity_np(&attr, sizeof(allowed_cpus), &allowed_cpus);
+        rc = pthread_create(th, &attr, radix_worker_main, w);
+    }
+    pthread_attr_destroy(&attr);
+    return rc;
+}
+
+unsigned radix_sort_threads(size_t n, unsigned nthreads) {
+    if (nthreads == 0) nthreads = nallowed_cpus;
+    size_t useful = n / MIN_PER_THREAD;
+    if (useful < 1) useful = 1;
+    if (nthreads > useful) nthreads = (unsigned)useful;
+    return nthreads;
+}
+
+int radix_sort(int arr[], size_t n, unsigned nthreads) {
+    if (n < 2) return 0;
+
+    nthreads = radix_sort_threads(n, nthreads);
+
+    radix_job job;
+    memset(&job, 0, sizeof(job));
+    job.n = n;
+    job.nthreads = nthreads;
+    job.bufs[0] = (uint32_t *)arr;
+    job.bufs[1] = aligned_alloc(CACHE_LINE, (n * sizeof(uint32_t) + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1));
+    job.counts = malloc(nthreads * sizeof(*job.counts));
+    job.offsets = malloc(nthreads * sizeof(*job.offsets));
+    job.wc = aligned_alloc(CACHE_LINE, nthreads * sizeof(wc_buffer));
+    pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+    radix_worker *workers = malloc(nthreads * sizeof(radix_worker));
+
+    int rc = -1, retry_serial = 0;
+    if (!job.bufs[1] || !job.counts || !job.offsets || !job.wc || !threads || !workers) goto out;
+
+    pthread_barrier_init(&job.barrier, NULL, nthreads);
+    pthread_mutex_init(&job.gate_lock, NULL);
+    pthread_cond_init(&job.gate_cond, NULL);
+
+    unsigned started = 1;
+    for (unsigned t = 0; t < nthreads; t++) {
+        workers[t].job = &job;
+        workers[t].id = t;
+    }
+    for (; started < nthreads; started++) {
+        if (spawn_worker(&threads[started], &workers[started]) != 0) break;
+    }
+
+    /* the caller is worker 0 */
+    open_gate(&job, started == nthreads ? 1 : -1);
+    if (started == nthreads) radix_worker_main(&workers[0]);
+    for (unsigned t = 1; t < started; t++) pthread_join(threads[t], NULL);
+
+    pthread_barrier_destroy(&job.barrier);
+    pthread_mutex_destroy(&job.gate_lock);
+    pthread_cond_destroy(&job.gate_cond);
+
+    if (started == nthreads) rc = 0;
+    else retry_serial = nthreads > 1;
+
+out:
+    free(job.bufs[1]);
+    free(job.counts);
+    free(job.offsets);
+    free(job.wc);
+    free(threads);
+    free(workers);
+    /* could not get the threads: go serial */
+    if (retry_serial) return radix_sort(arr, n, 1);
+    return rc;
+}
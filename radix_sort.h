@@ -0,0 +1,29 @@
+/* radix_sort.h - parallel LSD radix sort for 32-bit integer keys.
+ *
+ * Four 8-bit passes. In every pass each worker builds a histogram of its own
+ * slice, the histograms are prefix-summed bucket-major / thread-minor into
+ * private scatter offsets, and each worker scatters its slice through 64-byte
+ * software write-combining buffers (one cache line per bucket) flushed with
+ * non-temporal stores. Passes whose digit is identical for every key are skipped.
+ * The sort is stable and needs one n-element scratch buffer.
+ *
+ * Build: cc -O2 sort.c radix_sort.c ct_sort.c bench.c perf_counters.c -lpthread -lm -o sort
+ */
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <stddef.h>
+
+/* sort arr[0..n) ascending with nthreads workers (0 = all online CPUs).
+   Returns 0, or -1 if the scratch buffer or the threads could not be allocated. */
+int radix_sort(int arr[], size_t n, unsigned nthreads);
+
+/* the worker count radix_sort actually uses for n keys when asked for nthreads:
+   0 means all allowed CPUs, and each worker gets at least MIN_PER_THREAD keys */
+unsigned radix_sort_threads(size_t n, unsigned nthreads);
+
+/* CPUs in the process affinity mask at startup, before any caller pinned itself;
+   workers are spread over exactly these */
+unsigned radix_sort_cpus(void);
+
+#endif
@@ -1,7 +1,8 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
-#include <time.h>
+#include "bench.h"
+#include "cpu_dispatch.h"
 
 void ksa(uint8_t *key, uint8_t *S, size_t keylen) {
     for (int i = 0; i < 256; i++) {
@@ -17,7 +18,9 @@ void ksa(uint8_t *key, uint8_t *S, size_t keylen) {
     }
 }
 
-void prga(uint8_t *S, uint8_t *data, size_t datalen) {
+typedef void (*rc4_prga_fn)(uint8_t *S, uint8_t *data, size_t datalen);
+
+static void prga_scalar(uint8_t *S, uint8_t *data, size_t datalen) {
     int i = 0, j = 0;
     for (size_t k = 0; k < datalen; k++) {
         i = (i + 1) % 256;
@@ -30,7 +33,116 @@ void prga(uint8_t *S, uint8_t *data, size_t datalen) {
     }
 }
 
-int main() {
+/* Each byte depends on the swap before it, so RC4 has no SIMD form; this variant only
+   drops the signed % and reuses S[i] and S[j] from registers, two bytes per iteration. */
+static void prga_unrolled(uint8_t *S, uint8_t *data, size_t datalen) {
+    unsigned i = 0, j = 0;
+    size_t k = 0;
+    for (; k + 2 <= datalen; k += 2) {
+        i = (i + 1) & 255;
+        uint8_t si = S[i];
+        j = (j + si) & 255;
+        uint8_t sj = S[j];
+        S[i] = sj;
+        S[j] = si;
+        uint8_t k0 = S[(si + sj) & 255];
+
+        i = (i + 1) & 255;
+        si = S[i];
+        j = (j + si) & 255;
+        sj = S[j];
+        S[i] = sj;
+        S[j] = si;
+        uint8_t k1 = S[(si + sj) & 255];
+
+        data[k] ^= k0;
+        data[k + 1] ^= k1;
+    }
+    for (; k < datalen; k++) {
+        i = (i + 1) & 255;
+        uint8_t si = S[i];
+        j = (j + si) & 255;
+        uint8_t sj = S[j];
+        S[i] = sj;
+        S[j] = si;
+        data[k] ^= S[(si + sj) & 255];
+    }
+}
+
+/* no ISA-specific variants; the table exists so CPU_DISPATCH_RC4 can A/B them */
+static const struct {
+    cpu_variant variant;
+    rc4_prga_fn prga_fn;
+} rc4_variants[] = {
+    { { "unrolled", 0 }, prga_unrolled },
+    { { "scalar", 0 }, prga_scalar },
+};
+
+static rc4_prga_fn prga_impl = prga_scalar;
+
+/* bind the RC4 keystream kernel (or CPU_DISPATCH_RC4); returns the variant name */
+static const char *rc4_dispatch_init(void) {
+    size_t v = CPU_DISPATCH_SELECT("rc4", rc4_variants);
+    prga_impl = rc4_variants[v].prga_fn;
+    return rc4_variants[v].variant.name;
+}
+
+void prga(uint8_t *S, uint8_t *data, size_t datalen) {
+    prga_impl(S, data, datalen);
+}
+
+typedef struct {
+    uint8_t *key;
+    size_t keylen;
+    uint8_t *S;
+    uint8_t *data;
+    size_t datalen;
+} rc4_bench_ctx;
+
+static void bench_rc4_ksa(void *arg) {
+    rc4_bench_ctx *c = arg;
+    ksa(c->key, c->S, c->keylen);
+}
+
+static void bench_rc4_prga(void *arg) {
+    rc4_bench_ctx *c = arg;
+    prga(c->S, c->data, c->datalen);
+}
+
+/* prga encrypts in place, so the sweep only hands it the output buffer */
+static void stream_rc4_prga(void *S, const uint8_t *in, uint8_t *out, size_t len) {
+    (void)in;
+    prga(S, out, len);
+}
+
+/* Non-uniform data at an even and an odd length, so the odd-byte tail of the unrolled
+   loop runs too. */
+#define CHECK_SIZE (1024 + 64 + 17)
+
+static int check_against_reference(uint8_t *key, size_t keylen) {
+    static const size_t lengths[] = { 1024, CHECK_SIZE };
+    uint8_t S[256], in[CHECK_SIZE], out[CHECK_SIZE], ref[CHECK_SIZE];
+    uint32_t x = 0x9e3779b9;
+    for (size_t i = 0; i < CHECK_SIZE; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        in[i] = (uint8_t)x;
+    }
+
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        memcpy(out, in, lengths[l]);
+        memcpy(ref, in, lengths[l]);
+        ksa(key, S, keylen);
+        prga(S, out, lengths[l]);
+        ksa(key, S, keylen);
+        prga_scalar(S, ref, lengths[l]);
+        if (memcmp(out, ref, lengths[l]) != 0) return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
     uint8_t key[] = "secretkey";
     uint8_t S[256];
 
@@ -42,13 +154,25 @@ int main() {
 
     ksa(key, S, strlen((char *)key));
 
-    clock_t start = clock();
-    prga(S, ciphertext, sizeof(ciphertext));
-    clock_t end = clock();
+    rc4_dispatch_init();
+    bench_annotate("cpu_features", cpu_feature_names());
+    bench_annotate("dispatch", cpu_dispatch_report());
 
-    double time_taken = (double)(end - start) / CLOCKS_PER_SEC;
+    rc4_bench_ctx ctx = { key, strlen((char *)key), S, ciphertext, sizeof(ciphertext) };
+    bench_case k = { .name = "rc4_ksa", .run = bench_rc4_ksa, .ctx = &ctx };
+    bench_case p = { .name = "rc4_prga_1k", .run = bench_rc4_prga, .ctx = &ctx, .bytes = sizeof(ciphertext) };
+    bench_register(&k);
+    bench_register(&p);
 
-    printf("RC4 encryption time: %f seconds\n", time_taken);
+    bench_stream sweep = { .name = "rc4_prga", .fn = stream_rc4_prga, .ctx = S, .in_place = 1 };
+    bench_register_stream(&sweep);
 
-    return 0;
+    int rc = bench_main(argc, argv);
+
+    if (check_against_reference(key, strlen((char *)key)) != 0) {
+        printf("Keystream from %s does not match the reference.\n", cpu_dispatch_report());
+        rc = 1;
+    }
+
+    return rc;
 }
\ No newline at end of file
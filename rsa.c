@@ -2,6 +2,9 @@
 #include <stdlib.h>
 #include <gmp.h>
 #include <time.h>
+#include "bench.h"
+#include "cpu_dispatch.h"
+#include "modexp.h"
 
 void generate_rsa_keys(mpz_t n, mpz_t e, mpz_t d, gmp_randstate_t state, unsigned long int bits) {
     mpz_t p, q, phi, gcd;
@@ -36,14 +39,28 @@ void generate_rsa_keys(mpz_t n, mpz_t e, mpz_t d, gmp_randstate_t state, unsigne
 }
 
 void rsa_encrypt(mpz_t ciphertext, const mpz_t plaintext, const mpz_t e, const mpz_t n) {
-    mpz_powm(ciphertext, plaintext, e, n);
+    modexp(ciphertext, plaintext, e, n);
 }
 
 void rsa_decrypt(mpz_t plaintext, const mpz_t ciphertext, const mpz_t d, const mpz_t n) {
-    mpz_powm(plaintext, ciphertext, d, n);
+    modexp(plaintext, ciphertext, d, n);
 }
 
-int main() {
+typedef struct {
+    mpz_ptr n, e, d, plaintext, ciphertext, decrypted;
+} rsa_bench_ctx;
+
+static void bench_rsa_encrypt(void *arg) {
+    rsa_bench_ctx *c = arg;
+    rsa_encrypt(c->ciphertext, c->plaintext, c->e, c->n);
+}
+
+static void bench_rsa_decrypt(void *arg) {
+    rsa_bench_ctx *c = arg;
+    rsa_decrypt(c->decrypted, c->ciphertext, c->d, c->n);
+}
+
+int main(int argc, char **argv) {
     mpz_t n, e, d, plaintext, ciphertext, decrypted;
     mpz_inits(n, e, d, plaintext, ciphertext, decrypted, NULL);
 
@@ -57,25 +74,45 @@ int main() {
 
     mpz_set_ui(plaintext, 123456789);
 
-    clock_t start_enc = clock();
-    rsa_encrypt(ciphertext, plaintext, e, n);
-    clock_t end_enc = clock();
+    modexp_dispatch_init();
+    bench_annotate("cpu_features", cpu_feature_names());
+    bench_annotate("dispatch", cpu_dispatch_report());
+    bench_annotate("gmp", modexp_backend());
 
-    clock_t start_dec = clock();
-    rsa_decrypt(decrypted, ciphertext, d, n);
-    clock_t end_dec = clock();
+    rsa_bench_ctx ctx = { n, e, d, plaintext, ciphertext, decrypted };
+    bench_case enc = { .name = "rsa2048_encrypt", .run = bench_rsa_encrypt, .ctx = &ctx };
+    bench_case dec = { .name = "rsa2048_decrypt", .run = bench_rsa_decrypt, .ctx = &ctx,
+                       .samples = 200, .warmup = 10 };
+    bench_register(&enc);
+    bench_register(&dec);
 
-    double enc_time = (double)(end_enc - start_enc) / CLOCKS_PER_SEC;
-    double dec_time = (double)(end_dec - start_dec) / CLOCKS_PER_SEC;
+    int rc = bench_main(argc, argv);
 
+    /* round trip through the dispatched kernel, which must also agree with mpz_powm */
+    rsa_encrypt(ciphertext, plaintext, e, n);
+    rsa_decrypt(decrypted, ciphertext, d, n);
     gmp_printf("Plaintext: %Zd\n", plaintext);
     gmp_printf("Ciphertext: %Zd\n", ciphertext);
     gmp_printf("Decrypted: %Zd\n", decrypted);
-    printf("Encryption time: %f seconds\n", enc_time);
-    printf("Decryption time: %f seconds\n", dec_time);
+    if (mpz_cmp(decrypted, plaintext) != 0) {
+        printf("Decryption failed, plaintext does not match.\n");
+        rc = 1;
+    }
+
+    mpz_t reference;
+    mpz_init(reference);
+    mpz_powm(reference, plaintext, e, n);
+    int mismatch = mpz_cmp(reference, ciphertext) != 0;
+    mpz_powm(reference, ciphertext, d, n);
+    mismatch |= mpz_cmp(reference, decrypted) != 0;
+    if (mismatch) {
+        printf("Result from %s does not match mpz_powm.\n", cpu_dispatch_report());
+        rc = 1;
+    }
+    mpz_clear(reference);
 
     mpz_clears(n, e, d, plaintext, ciphertext, decrypted, NULL);
     gmp_randclear(state);
 
-    return 0;
+    return rc;
 }
\ No newline at end of file
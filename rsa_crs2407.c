@@ -1,18 +1,58 @@
+#define _GNU_SOURCE   // for sched_setaffinity and CPU_SET
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <inttypes.h>
 #include <gmp.h>
-#include <x86intrin.h>   // for __rdtsc
 #include <time.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sched.h>
+#include "bench.h"       // serialized TSC reads
+#include "histogram.h"
+#include "cpu_dispatch.h"
+#include "modexp.h"
 
 #define ITER_PRIME_GEN 1000UL   /* set lower for development; change to 1000000 if you will run long */
 #define MESSAGE_BITS 1023
+#define RAW_MAGIC "RSACYC01"
+
+/* timed steps per iteration; one histogram per (size, step) */
+enum { STEP_P, STEP_Q, STEP_N_PHI, STEP_D, STEP_ENC, STEP_DEC, NSTEPS };
+static const char *step_batch[NSTEPS] = { "prime_gen", "prime_gen", "compute", "compute", "encrypt", "encrypt" };
+static const char *step_name[NSTEPS] = { "p", "q", "N_phi", "d", "enc", "dec" };
+
+/* one record of the --raw dump: 16 bytes, native byte order, after the 8-byte RAW_MAGIC header */
+typedef struct raw_sample {
+    uint16_t bits;
+    uint8_t step;
+    uint8_t reserved;
+    uint32_t iteration;
+    uint64_t cycles;
+} raw_sample;
+
+/* in-memory sinks for the measurement loop; nothing here does I/O */
+typedef struct sample_sink {
+    histogram *hists;       /* NSTEPS histograms for the current size */
+    raw_sample *raw;        /* NULL unless --raw was given */
+    size_t nraw;
+    unsigned int bits;
+} sample_sink;
+
+static inline void record_sample(sample_sink *sink, int step, unsigned long iter, uint64_t cycles) {
+    hist_record(&sink->hists[step], cycles);
+    if (sink->raw) {
+        raw_sample *r = &sink->raw[sink->nraw++];
+        r->bits = (uint16_t)sink->bits;
+        r->step = (uint8_t)step;
+        r->reserved = 0;
+        r->iteration = (uint32_t)iter;
+        r->cycles = cycles;
+    }
+}
 
 /* read 64-bit seed from /dev/urandom */
 static unsigned long long get_entropy_u64() {
@@ -45,12 +85,6 @@ void force_bitlength_and_odd(mpz_t x, unsigned int bits) {
     mpz_setbit(x, 0);      // ensure odd
 }
 
-uint64_t rdtsc_now() {
-    /* Use serializing rdtsc? Use __rdtsc() which is fine for this task.
-       Optionally could use RDTSCP for serialization. */
-    return __rdtsc();
-}
-
 void generate_random_prime(mpz_t out, gmp_randstate_t state, unsigned int bits) {
     mpz_t candidate;
     mpz_init(candidate);
@@ -69,11 +103,33 @@ void generate_random_prime(mpz_t out, gmp_randstate_t state, unsigned int bits)
     mpz_clear(candidate);
 }
 
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [ITERATIONS] [--raw FILE]\n"
+                    "  ITERATIONS  positive count per key size (default %lu)\n"
+                    "  --raw FILE  also write every sample as binary records to FILE\n",
+            prog, ITER_PRIME_GEN);
+}
+
 int main(int argc, char **argv) {
     pin_to_cpu0();
+    modexp_dispatch_init();
 
     unsigned long iterations = ITER_PRIME_GEN;
-    if (argc >= 2) iterations = strtoul(argv[1], NULL, 10);
+    const char *raw_path = NULL;
+    for (int a = 1; a < argc; ++a) {
+        char *end;
+        if (strcmp(argv[a], "--raw") == 0 && a + 1 < argc) {
+            raw_path = argv[++a];
+            continue;
+        }
+        /* a typo, --help or a --raw without a path must not become 0 iterations */
+        if (argv[a][0] >= '0' && argv[a][0] <= '9') {
+            iterations = strtoul(argv[a], &end, 10);
+            if (*end == '\0' && iterations > 0) continue;
+        }
+        usage(argv[0]);
+        return 1;
+    }
 
     unsigned int prime_bits_list[3] = {512, 768, 1024};
     size_t sets = 3;
@@ -84,15 +140,30 @@ int main(int argc, char **argv) {
     unsigned long long seed = get_entropy_u64();
     gmp_randseed_ui(rstate, (unsigned long)(seed & 0xffffffffUL));
 
-    printf("# Iterations per size: %lu\n", iterations);
-    printf("# Fields: size,batch,step,iteration,cycles\n");
+    /* all output is deferred until the loops finish; allocate the sinks up front */
+    histogram *hists = malloc(sets * NSTEPS * sizeof(histogram));
+    unsigned long invert_failures[3] = {0}, mismatches[3] = {0};
+    sample_sink sink = {0};
+    FILE *raw_file = NULL;
+    if (!hists) { perror("malloc"); exit(1); }
+    for (size_t k = 0; k < sets * NSTEPS; ++k) hist_init(&hists[k]);
+    int raw_failed = 0;
+    if (raw_path) {
+        if (iterations > SIZE_MAX / (NSTEPS * sizeof(raw_sample))) {
+            fprintf(stderr, "--raw: %lu iterations do not fit in one sample buffer\n", iterations);
+            exit(1);
+        }
+        raw_file = fopen(raw_path, "wb");
+        sink.raw = malloc(iterations * NSTEPS * sizeof(raw_sample));
+        if (!raw_file || !sink.raw) { perror(raw_path); exit(1); }
+        if (fwrite(RAW_MAGIC, 1, 8, raw_file) != 8) { perror(raw_path); exit(1); }
+    }
 
     for (size_t s = 0; s < sets; ++s) {
         unsigned int bits = prime_bits_list[s];
-
-        /* arrays to keep min/max/total for prime generation (for p and q combined) */
-        uint64_t min_cycles_p = UINT64_MAX, max_cycles_p = 0, sum_cycles_p = 0;
-        uint64_t min_cycles_q = UINT64_MAX, max_cycles_q = 0, sum_cycles_q = 0;
+        sink.hists = &hists[s * NSTEPS];
+        sink.bits = bits;
+        sink.nraw = 0;
 
         /* per-iteration loop */
         for (unsigned long i = 0; i < iterations; ++i) {
@@ -101,52 +172,39 @@ int main(int argc, char **argv) {
             mpz_init(q);
 
             /* time p generation */
-            uint64_t t0 = rdtsc_now();
+            uint64_t t0 = bench_tsc_begin();
             generate_random_prime(p, rstate, bits);
-            uint64_t t1 = rdtsc_now();
-            uint64_t cyc_p = t1 - t0;
-            if (cyc_p < min_cycles_p) min_cycles_p = cyc_p;
-            if (cyc_p > max_cycles_p) max_cycles_p = cyc_p;
-            sum_cycles_p += cyc_p;
+            uint64_t t1 = bench_tsc_end();
+            record_sample(&sink, STEP_P, i, t1 - t0);
 
             /* time q generation */
-            t0 = rdtsc_now();
+            t0 = bench_tsc_begin();
             generate_random_prime(q, rstate, bits);
-            t1 = rdtsc_now();
-            uint64_t cyc_q = t1 - t0;
-            if (cyc_q < min_cycles_q) min_cycles_q = cyc_q;
-            if (cyc_q > max_cycles_q) max_cycles_q = cyc_q;
-            sum_cycles_q += cyc_q;
-
-            /* output raw iteration data (optional) */
-            printf("%u,prime_gen,p,%lu,%" PRIu64 "\n", bits, i, cyc_p);
-            printf("%u,prime_gen,q,%lu,%" PRIu64 "\n", bits, i, cyc_q);
+            t1 = bench_tsc_end();
+            record_sample(&sink, STEP_Q, i, t1 - t0);
 
             /* Step 2: compute N and phi, time it */
             mpz_t N, phi, tmp1, tmp2;
             mpz_init(N); mpz_init(phi); mpz_init(tmp1); mpz_init(tmp2);
 
-            t0 = rdtsc_now();
+            t0 = bench_tsc_begin();
             mpz_mul(N, p, q);                  // N = p * q
             mpz_sub_ui(tmp1, p, 1);            // tmp1 = p-1
             mpz_sub_ui(tmp2, q, 1);            // tmp2 = q-1
             mpz_mul(phi, tmp1, tmp2);          // phi = (p-1)*(q-1)
-            t1 = rdtsc_now();
-            uint64_t cyc_N_phi = t1 - t0;
-            printf("%u,compute,N_phi,0,%" PRIu64 "\n", bits, cyc_N_phi);
+            t1 = bench_tsc_end();
+            record_sample(&sink, STEP_N_PHI, i, t1 - t0);
 
             /* Step 3: compute d = invmod(e, phi) */
             mpz_t e, d;
             mpz_init_set_ui(e, 65537UL);
             mpz_init(d);
 
-            t0 = rdtsc_now();
-            if (mpz_invert(d, e, phi) == 0) {
-                fprintf(stderr, "Error: e not invertible mod phi (rare). Re-generate primes.\n");
-            }
-            t1 = rdtsc_now();
-            uint64_t cyc_d = t1 - t0;
-            printf("%u,compute,d,0,%" PRIu64 "\n", bits, cyc_d);
+            t0 = bench_tsc_begin();
+            int invertible = mpz_invert(d, e, phi);
+            t1 = bench_tsc_end();
+            record_sample(&sink, STEP_D, i, t1 - t0);
+            if (!invertible) invert_failures[s]++;   /* e not invertible mod phi (rare) */
 
             /* Step 4: message encryption/decryption (single trial per iteration) */
             mpz_t m, c, m2;
@@ -160,22 +218,18 @@ int main(int argc, char **argv) {
             }
 
             /* encrypt: c = m^e mod N */
-            t0 = rdtsc_now();
-            mpz_powm(c, m, e, N);
-            t1 = rdtsc_now();
-            uint64_t cyc_enc = t1 - t0;
-            printf("%u,encrypt,enc,0,%" PRIu64 "\n", bits, cyc_enc);
+            t0 = bench_tsc_begin();
+            modexp(c, m, e, N);
+            t1 = bench_tsc_end();
+            record_sample(&sink, STEP_ENC, i, t1 - t0);
 
             /* decrypt: m2 = c^d mod N */
-            t0 = rdtsc_now();
-            mpz_powm(m2, c, d, N);
-            t1 = rdtsc_now();
-            uint64_t cyc_dec = t1 - t0;
-            printf("%u,encrypt,dec,0,%" PRIu64 "\n", bits, cyc_dec);
-
-            if (mpz_cmp(m, m2) != 0) {
-                fprintf(stderr, "Decryption mismatch on iteration %lu size %u!\n", i, bits);
-            }
+            t0 = bench_tsc_begin();
+            modexp(m2, c, d, N);
+            t1 = bench_tsc_end();
+            record_sample(&sink, STEP_DEC, i, t1 - t0);
+
+            if (mpz_cmp(m, m2) != 0) mismatches[s]++;
 
             /* clear for next iter */
             mpz_clear(p); mpz_clear(q);
@@ -184,18 +238,50 @@ int main(int argc, char **argv) {
             mpz_clear(m); mpz_clear(c); mpz_clear(m2);
         }
 
-        /* print summary statistics for p and q */
-        double avg_p = (double)sum_cycles_p / (double)iterations;
-        double avg_q = (double)sum_cycles_q / (double)iterations;
-        printf("%u,summary,p,min,%" PRIu64 "\n", bits, min_cycles_p);
-        printf("%u,summary,p,max,%" PRIu64 "\n", bits, max_cycles_p);
-        printf("%u,summary,p,avg,%.2f\n", bits, avg_p);
+        /* raw samples for this size go out only after its loop is done */
+        if (raw_file && !raw_failed && fwrite(sink.raw, sizeof(raw_sample), sink.nraw, raw_file) != sink.nraw) {
+            perror(raw_path);   /* e.g. disk full: the dump is incomplete, keep going but fail at the end */
+            raw_failed = 1;
+        }
+    }
 
-        printf("%u,summary,q,min,%" PRIu64 "\n", bits, min_cycles_q);
-        printf("%u,summary,q,max,%" PRIu64 "\n", bits, max_cycles_q);
-        printf("%u,summary,q,avg,%.2f\n", bits, avg_q);
+    printf("# Iterations per size: %lu\n", iterations);
+    printf("# dispatch: %s (%s)\n", cpu_dispatch_report(), modexp_backend());
+    printf("# Fields: size,batch,step,stat,cycles\n");
+    printf("# Percentiles come from log-bucketed histograms (within 0.8%%); min/max/avg are exact\n");
+
+    static const struct { const char *name; double pct; } stats[] = {
+        { "p50", 50.0 }, { "p90", 90.0 }, { "p99", 99.0 }, { "p99.9", 99.9 }
+    };
+    for (size_t s = 0; s < sets; ++s) {
+        unsigned int bits = prime_bits_list[s];
+        for (int step = 0; step < NSTEPS; ++step) {
+            const histogram *h = &hists[s * NSTEPS + step];
+            const char *batch = step_batch[step], *name = step_name[step];
+            printf("%u,%s,%s,count,%" PRIu64 "\n", bits, batch, name, h->count);
+            printf("%u,%s,%s,min,%" PRIu64 "\n", bits, batch, name, h->min);
+            for (size_t k = 0; k < sizeof(stats) / sizeof(stats[0]); ++k) {
+                printf("%u,%s,%s,%s,%" PRIu64 "\n", bits, batch, name, stats[k].name,
+                       hist_percentile(h, stats[k].pct));
+            }
+            printf("%u,%s,%s,max,%" PRIu64 "\n", bits, batch, name, h->max);
+            printf("%u,%s,%s,avg,%.2f\n", bits, batch, name, hist_mean(h));
+        }
+        if (invert_failures[s])
+            fprintf(stderr, "Error: e not invertible mod phi in %lu iterations at size %u.\n", invert_failures[s], bits);
+        if (mismatches[s])
+            fprintf(stderr, "Decryption mismatch in %lu iterations at size %u!\n", mismatches[s], bits);
     }
 
+    if (raw_file) {
+        if (fclose(raw_file) != 0 && !raw_failed) {
+            perror(raw_path);
+            raw_failed = 1;
+        }
+        if (raw_failed) fprintf(stderr, "%s is incomplete.\n", raw_path);
+        free(sink.raw);
+    }
+    free(hists);
     gmp_randclear(rstate);
-    return 0;
+    return raw_failed ? 1 : 0;
 }
\ No newline at end of file
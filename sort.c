@@ -1,6 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include "bench.h"
+#include "radix_sort.h"
+#include "ct_sort.h"
 
 void insertion_sort(int arr[], int n) {
     for (int i = 1; i < n; i++) {
@@ -21,39 +25,248 @@ int compare_ints(const void *a, const void *b) {
     return (arg1 > arg2) - (arg1 < arg2);
 }
 
-int main() {
-    int n = 100000;
-    int *arr1 = malloc(n * sizeof(int));
-    int *arr2 = malloc(n * sizeof(int));
+#define INSERTION_SORT_MAX 100000     /* O(n^2): only benchmarked up to this size */
+#define CT_SORT_MAX (1 << 20)         /* O(n log^2 n) network: benchmarked at 1K-1M */
+#define LEAK_TEST_N 1024
+#define MAX_SIZES 8
+#define MAX_THREAD_COUNTS 8
 
-    if (arr1 == NULL || arr2 == NULL) {
-        printf("Memory allocation failed\n");
-        return 1;
+typedef struct {
+    const int *src;
+    int *work;
+    size_t n;
+    unsigned threads;
+} sort_bench_ctx;
+
+/* restore the unsorted input before every sample */
+static void bench_sort_setup(void *arg) {
+    sort_bench_ctx *c = arg;
+    memcpy(c->work, c->src, c->n * sizeof(int));
+}
+
+static void bench_insertion_sort(void *arg) {
+    sort_bench_ctx *c = arg;
+    insertion_sort(c->work, (int)c->n);
+}
+
+static void bench_qsort(void *arg) {
+    sort_bench_ctx *c = arg;
+    qsort(c->work, c->n, sizeof(int), compare_ints);
+}
+
+static void bench_radix_sort(void *arg) {
+    sort_bench_ctx *c = arg;
+    if (radix_sort(c->work, c->n, c->threads) != 0) {
+        fprintf(stderr, "radix_sort: out of memory at n=%zu\n", c->n);
+        exit(1);
     }
+}
 
-    srand(time(NULL));
-    for (int i = 0; i < n; i++) {
-        int val = rand();
-        arr1[i] = val;
-        arr2[i] = val;
+static void bench_ct_sort(void *arg) {
+    sort_bench_ctx *c = arg;
+    ct_sort(c->work, c->n);
+}
+
+static void bench_ct_sort_scalar(void *arg) {
+    sort_bench_ctx *c = arg;
+    ct_sort_scalar(c->work, c->n);
+}
+
+/* leakage classes: 0 = already sorted, 1 = random; a data-dependent sort times these differently */
+static void leak_prepare(void *arg, int cls) {
+    sort_bench_ctx *c = arg;
+    for (size_t i = 0; i < c->n; i++) {
+        c->work[i] = cls ? rand() : (int)i;
+    }
+}
+
+/* Compare both ct_sort implementations with qsort at CT_SORT_MAX keys and at an odd
+   length just below it, whatever SORT_SIZES holds. The AVX2 one only runs where the CPU
+   has it. Returns the number of mismatches, or -1 if the buffers cannot be allocated. */
+static int check_ct_sort(void) {
+    static const size_t lengths[] = { CT_SORT_MAX, CT_SORT_MAX - 3 };
+    int32_t *src = malloc(CT_SORT_MAX * sizeof(int32_t));
+    int32_t *expect = malloc(CT_SORT_MAX * sizeof(int32_t));
+    int32_t *check = malloc(CT_SORT_MAX * sizeof(int32_t));
+    if (!src || !expect || !check) {
+        free(src);
+        free(expect);
+        free(check);
+        return -1;
+    }
+    int failures = 0;
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        size_t n = lengths[l];
+        for (size_t i = 0; i < n; i++) src[i] = rand() - RAND_MAX / 2;
+        memcpy(expect, src, n * sizeof(int32_t));
+        qsort(expect, n, sizeof(int32_t), compare_ints);
+
+        static const struct {
+            const char *name;
+            void (*sort)(int32_t *, size_t);
+        } impls[] = { { "avx2", ct_sort_avx2 }, { "scalar", ct_sort_scalar } };
+        for (size_t k = 0; k < sizeof(impls) / sizeof(impls[0]); k++) {
+            if (strcmp(impls[k].name, "avx2") == 0 && strcmp(ct_sort_variant(), "avx2") != 0) continue;
+            memcpy(check, src, n * sizeof(int32_t));
+            impls[k].sort(check, n);
+            int ok = memcmp(check, expect, n * sizeof(int32_t)) == 0;
+            printf("ct_sort_%s %s qsort on %zu keys.\n", impls[k].name, ok ? "matches" : "does not match", n);
+            failures += !ok;
+        }
+    }
+    free(src);
+    free(expect);
+    free(check);
+    return failures;
+}
+
+/* comma-separated list from the environment, e.g. SORT_SIZES=1000000,100000000 */
+static size_t parse_list(const char *env, size_t *out, size_t max) {
+    const char *s = getenv(env);
+    size_t count = 0;
+    while (s && *s && count < max) {
+        char *end;
+        unsigned long long v = strtoull(s, &end, 10);
+        if (end == s) break;
+        if (v) out[count++] = (size_t)v;
+        s = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+/* 100000 -> "100k", 10000000 -> "10M" */
+static void format_count(char *buf, size_t len, size_t n) {
+    if (n % 1000000000 == 0) snprintf(buf, len, "%zuG", n / 1000000000);
+    else if (n % 1000000 == 0) snprintf(buf, len, "%zuM", n / 1000000);
+    else if (n % 1000 == 0) snprintf(buf, len, "%zuk", n / 1000);
+    else snprintf(buf, len, "%zu", n);
+}
+
+int main(int argc, char **argv) {
+    size_t sizes[MAX_SIZES] = { 1000, 100000, 1000000, 10000000 };
+    size_t nsizes = parse_list("SORT_SIZES", sizes, MAX_SIZES);
+    if (nsizes == 0) nsizes = 4;
+
+    /* thread counts 1, 2, 4, ... up to the CPUs the process may use unless SORT_THREADS says otherwise */
+    size_t threads[MAX_THREAD_COUNTS];
+    size_t nthreads = parse_list("SORT_THREADS", threads, MAX_THREAD_COUNTS);
+    if (nthreads == 0) {
+        long ncpu = (long)radix_sort_cpus();
+        for (size_t t = 1; nthreads < MAX_THREAD_COUNTS; t *= 2) {
+            threads[nthreads++] = t < (size_t)ncpu ? t : (size_t)ncpu;
+            if (t >= (size_t)ncpu) break;
+        }
     }
 
-    clock_t start_ins = clock();
-    insertion_sort(arr1, n);
-    clock_t end_ins = clock();
+    int *src[MAX_SIZES] = {0}, *work[MAX_SIZES] = {0};
+    static sort_bench_ctx ctx[MAX_SIZES][MAX_THREAD_COUNTS + 1];
+    static char names[MAX_SIZES][MAX_THREAD_COUNTS + 4][48];
 
-    clock_t start_qs = clock();
-    qsort(arr2, n, sizeof(int), compare_ints);
-    clock_t end_qs = clock();
+    srand(time(NULL));
+    for (size_t s = 0; s < nsizes; s++) {
+        size_t n = sizes[s];
+        src[s] = malloc(n * sizeof(int));
+        work[s] = malloc(n * sizeof(int));
+
+        if (src[s] == NULL || work[s] == NULL) {
+            printf("Memory allocation failed\n");
+            return 1;
+        }
 
-    double time_ins = (double)(end_ins - start_ins) / CLOCKS_PER_SEC;
-    double time_qs = (double)(end_qs - start_qs) / CLOCKS_PER_SEC;
+        for (size_t i = 0; i < n; i++) {
+            src[s][i] = rand();
+        }
+
+        /* fewer samples for bigger arrays: roughly 10^7 keys sorted per case */
+        unsigned samples = (unsigned)(10000000 / n);
+        if (samples > 100) samples = 100;
+        if (samples < 3) samples = 3;
+        unsigned warmup = samples / 20 + 1;
+        char count[24];
+        format_count(count, sizeof(count), n);
 
-    printf("Insertion sort time: %f seconds\n", time_ins);
-    printf("qsort time: %f seconds\n", time_qs);
+        ctx[s][0] = (sort_bench_ctx){ src[s], work[s], n, 1 };
+        if (n <= INSERTION_SORT_MAX) {
+            snprintf(names[s][0], sizeof(names[s][0]), "insertion_sort_%s", count);
+            bench_case ins = { .name = names[s][0], .setup = bench_sort_setup, .run = bench_insertion_sort,
+                               .ctx = &ctx[s][0], .bytes = n * sizeof(int), .samples = 5, .warmup = 1 };
+            bench_register(&ins);
+        }
+        snprintf(names[s][1], sizeof(names[s][1]), "qsort_%s", count);
+        bench_case qs = { .name = names[s][1], .setup = bench_sort_setup, .run = bench_qsort,
+                          .ctx = &ctx[s][0], .bytes = n * sizeof(int), .samples = samples, .warmup = warmup };
+        bench_register(&qs);
 
-    free(arr1);
-    free(arr2);
+        /* name each case after the worker count radix_sort really runs, and skip requested
+           counts it would cap to one already registered (small arrays stay single-threaded) */
+        unsigned used[MAX_THREAD_COUNTS];
+        size_t nused = 0;
+        for (size_t t = 0; t < nthreads; t++) {
+            unsigned eff = radix_sort_threads(n, (unsigned)threads[t]);
+            size_t u = 0;
+            while (u < nused && used[u] != eff) u++;
+            if (u < nused) continue;
+            used[nused++] = eff;
+            ctx[s][t + 1] = (sort_bench_ctx){ src[s], work[s], n, eff };
+            snprintf(names[s][t + 2], sizeof(names[s][t + 2]), "radix_sort_%s_t%u", count, eff);
+            bench_case rs = { .name = names[s][t + 2], .setup = bench_sort_setup, .run = bench_radix_sort,
+                              .ctx = &ctx[s][t + 1], .bytes = n * sizeof(int), .samples = samples, .warmup = warmup,
+                              .threads = eff };
+            bench_register(&rs);
+        }
+
+        if (n <= CT_SORT_MAX) {
+            char *ct_name = names[s][nthreads + 2], *scalar_name = names[s][nthreads + 3];
+            snprintf(ct_name, 48, "ct_sort_%s_%s", ct_sort_variant(), count);
+            bench_case ct = { .name = ct_name, .setup = bench_sort_setup, .run = bench_ct_sort,
+                              .ctx = &ctx[s][0], .bytes = n * sizeof(int), .samples = samples, .warmup = warmup };
+            bench_register(&ct);
+            if (strcmp(ct_sort_variant(), "scalar") != 0) {
+                snprintf(scalar_name, 48, "ct_sort_scalar_%s", count);
+                bench_case cs = { .name = scalar_name, .setup = bench_sort_setup, .run = bench_ct_sort_scalar,
+                                  .ctx = &ctx[s][0], .bytes = n * sizeof(int), .samples = samples, .warmup = warmup };
+                bench_register(&cs);
+            }
+        }
+    }
+
+    /* --leak: ct_sort must show no timing difference between sorted and random input;
+       qsort is the control that should */
+    static int leak_buf[LEAK_TEST_N];
+    static sort_bench_ctx leak_ctx = { NULL, leak_buf, LEAK_TEST_N, 1 };
+    bench_leak ct_leak = { .name = "ct_sort_1k", .prepare = leak_prepare, .run = bench_ct_sort, .ctx = &leak_ctx };
+    bench_leak qs_leak = { .name = "qsort_1k", .prepare = leak_prepare, .run = bench_qsort, .ctx = &leak_ctx };
+    bench_register_leak(&ct_leak);
+    bench_register_leak(&qs_leak);
+    /* the scalar fallback is branch-free only as far as the compiler keeps it so; test it too */
+    bench_leak cs_leak = { .name = "ct_sort_scalar_1k", .prepare = leak_prepare, .run = bench_ct_sort_scalar,
+                           .ctx = &leak_ctx };
+    if (strcmp(ct_sort_variant(), "scalar") != 0) bench_register_leak(&cs_leak);
+
+    int rc = bench_main(argc, argv);
+
+    /* cross-check the radix sort against qsort on the largest array */
+    size_t last = nsizes - 1, n = sizes[last];
+    memcpy(work[last], src[last], n * sizeof(int));
+    qsort(work[last], n, sizeof(int), compare_ints);
+    int *check = malloc(n * sizeof(int));
+    if (check) {
+        memcpy(check, src[last], n * sizeof(int));
+        radix_sort(check, n, (unsigned)threads[nthreads - 1]);
+        if (memcmp(check, work[last], n * sizeof(int)) == 0) {
+            printf("radix_sort matches qsort on %zu keys.\n", n);
+        } else {
+            printf("radix_sort does not match qsort on %zu keys.\n", n);
+            rc = 1;
+        }
+        free(check);
+    }
+    if (check_ct_sort() != 0) rc = 1;
+
+    for (size_t s = 0; s < nsizes; s++) {
+        free(src[s]);
+        free(work[s]);
+    }
 
-    return 0;
+    return rc;
 }
\ No newline at end of file